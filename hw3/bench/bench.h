@@ -0,0 +1,28 @@
+#ifndef BENCH_H
+#define BENCH_H
+
+/*
+ * Helpers shared by the benchmarks in bench/ and the sfmm_bench and sfmm_replay tools. They use
+ * clock_gettime, so a file defines _POSIX_C_SOURCE or _DEFAULT_SOURCE before its first include.
+ */
+
+#include <stdint.h>
+#include <time.h>
+#include "timing.h"
+
+// Returns the time of the monotonic clock in seconds.
+static inline double now_sec() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+// Advances a 32-bit xorshift generator, whose state must not be 0, and returns its new state.
+static inline uint32_t next_rand(uint32_t* rng) {
+    *rng ^= *rng << 13;
+    *rng ^= *rng >> 17;
+    *rng ^= *rng << 5;
+    return *rng;
+}
+
+#endif
@@ -0,0 +1,84 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "sfmm.h"
+#include "bench.h"
+
+/*
+ * Measures sf_free latency as the number of free blocks in a single free list grows.
+ *
+ * The heap is laid out as alternating free and allocated blocks of the same size class:
+ *
+ *     [F0][A0][F1][A1] ... [Fn-1][An-1][wilderness]
+ *
+ * Freeing A0, A1, ... coalesces each one with the free blocks on both sides. Those neighbours
+ * were freed first, so with LIFO insertion they sit at the tail of their free list, which is
+ * the worst case for any free-list maintenance that has to walk the list.
+ */
+
+#define PAYLOAD_SZ 184  /* Block size 192: above the quick list range, free list (128, 256]. */
+#define MAX_BLKS   60   /* The sfutil heap is 24 KiB, so at most ~63 free/alloc pairs fit. */
+#define TIMED_FREES 8   /* Frees timed per round, taken from the deep end of the list. */
+#define ROUNDS     2000
+
+static const int free_blk_counts[] = {4, 8, 16, 32, MAX_BLKS};
+
+// Runs all rounds for one free block count and returns the average latency of a free in ns.
+static double measure(int n) {
+    void* blks[2 * MAX_BLKS];
+    uint64_t total = 0;
+
+    for(int r = 0; r < ROUNDS; r++) {
+        // The heap is a single free block at the start of each round, so this layout is identical every time.
+        for(int i = 0; i < 2 * n; i++) {
+            if(!(blks[i] = sf_malloc(PAYLOAD_SZ))) {
+                fprintf(stderr, "sf_malloc failed while building a layout with %d free blocks\n", n);
+                exit(EXIT_FAILURE);
+            }
+        }
+        for(int i = 0; i < 2 * n; i += 2) {sf_free(blks[i]);}
+
+        uint64_t start = now_ns();
+        for(int i = 1; i < 2 * TIMED_FREES && i < 2 * n; i += 2) {sf_free(blks[i]);}
+        total += now_ns() - start;
+
+        for(int i = 2 * TIMED_FREES + 1; i < 2 * n; i += 2) {sf_free(blks[i]);}
+    }
+
+    int timed = n < TIMED_FREES ? n : TIMED_FREES;
+    return (double) total / ((double) ROUNDS * timed);
+}
+
+int main(int argc, char const *argv[]) {
+    printf("%12s %12s\n", "free blocks", "ns/free");
+
+    for(int i = 0; i < sizeof(free_blk_counts) / sizeof(free_blk_counts[0]); i++) {
+        // Every measurement runs in its own process so that it starts from a fresh heap.
+        int fds[2];
+        if(pipe(fds) == -1) {return EXIT_FAILURE;}
+
+        pid_t pid = fork();
+        if(pid == 0) {
+            double ns = measure(free_blk_counts[i]);
+            if(write(fds[1], &ns, sizeof(ns)) != sizeof(ns)) {_exit(EXIT_FAILURE);}
+            _exit(EXIT_SUCCESS);
+        }
+
+        double ns = 0.0;
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS ||
+           read(fds[0], &ns, sizeof(ns)) != sizeof(ns)) {
+            return EXIT_FAILURE;
+        }
+        close(fds[0]);
+        close(fds[1]);
+
+        printf("%12d %12.1f\n", free_blk_counts[i], ns);
+    }
+
+    return EXIT_SUCCESS;
+}
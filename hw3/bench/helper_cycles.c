@@ -0,0 +1,221 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <limits.h>
+#include <time.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "helper.h"
+#include "arena.h"
+#include "bench.h"
+
+/*
+ * Microbenchmarks for the helper.c hot paths. Each function is called in batches against a heap
+ * state that is built once and restored after every batch, outside the timed region, so every
+ * batch sees the same lists. Prints the median and minimum cost of one call over SAMPLES batches,
+ * in cycles and in ns, after WARMUP untimed batches. The cost of reading the clock is measured
+ * with an empty batch and subtracted.
+ *
+ * On x86 the cycles are read with rdtsc, which counts at a constant rate, so they are reference
+ * cycles rather than core cycles. Elsewhere, both columns are in ns.
+ *
+ * The heap state is built with heap_malloc and heap_free, which bypass slabs, thread caches and
+ * direct mappings, so every build measures the same code. It holds:
+ *
+ *     [F0][G0][F1][G1] ... [F7][G7][wilderness]
+ *
+ * where the Fi are free BIG_SIZE blocks, the Gi are allocated guard blocks, and the quick list of
+ * QUICK_SIZE blocks holds QUICK_BLKS blocks. The coalescing benchmarks split each Fi into two free
+ * halves first, with coalescing deferred so that the halves stay apart.
+ */
+
+#define SAMPLES    2000
+#define WARMUP     200
+#define PURE_BATCH 256
+
+#define BIG_BLKS   8
+#define BIG_SIZE   512
+#define HALF_SIZE  (BIG_SIZE / 2)
+#define GUARD_SIZE 224   /* Above the quick list range, so guards never move. */
+#define QUICK_SIZE 48
+#define QUICK_BLKS 4     /* Below QUICK_LIST_MAX, so refilling the list never flushes it. */
+#define MISS_SIZE  176   /* A quick list size that is never freed, so lookups always miss. */
+
+struct micro {
+    const char* name;
+    int batch;
+    void (*begin)();        // Called once before the samples, or NULL.
+    void (*op)(int i);      // The timed call, for the i-th call of a batch.
+    void (*undo)();         // Restores the heap state after a batch, or NULL.
+    void (*end)();          // Called once after the samples, or NULL.
+};
+
+static uint32_t req_sizes[PURE_BATCH];
+static uint32_t blk_sizes[PURE_BATCH];
+static volatile uint64_t sink;
+
+static sf_block* big_blks[BIG_BLKS];
+static void* results[PURE_BATCH];
+
+// Reads the cycle counter, fenced so that the timed calls cannot move across it.
+static inline uint64_t ticks() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_lfence();
+    uint64_t t = __builtin_ia32_rdtsc();
+    __builtin_ia32_lfence();
+    return t;
+#else
+    return now_ns();
+#endif
+}
+
+static sf_block* block_of(void* payload) {
+    return (sf_block*) ((char*) payload - 16);
+}
+
+static void op_get_req_blk_size(int i) {sink += get_req_blk_size(req_sizes[i]);}
+static void op_get_quick_list_idx(int i) {sink += get_quick_list_idx(blk_sizes[i]);}
+static void op_get_free_list_idx(int i) {sink += get_free_list_idx(blk_sizes[i]);}
+
+static void op_search_quicklists_hit(int i) {results[i] = search_quicklists(QUICK_SIZE, QUICK_SIZE - 8);}
+static void op_search_quicklists_miss(int i) {results[i] = search_quicklists(MISS_SIZE, MISS_SIZE - 8);}
+
+// Returns the blocks taken from the quick list, as heap_free does.
+static void undo_search_quicklists() {
+    for(int i = QUICK_BLKS - 1; i >= 0; i--) {
+        sf_block* blk = block_of(results[i]);
+        set_blk_header(blk, QUICK_SIZE, 0, get_info_bits(blk) | 1);
+        add_quick_list_blk(blk, QUICK_SIZE);
+    }
+}
+
+static void op_search_freelists(int i) {results[i] = search_freelists(HALF_SIZE, HALF_SIZE - 8);}
+static void op_split_free_block(int i) {results[i] = split_free_block(big_blks[i], HALF_SIZE, HALF_SIZE - 8);}
+
+// search_freelists returns payloads and split_free_block returns blocks, so each gets its own undo.
+static void undo_search_freelists() {
+    for(int i = BIG_BLKS - 1; i >= 0; i--) {heap_free(block_of(results[i]));}
+}
+
+static void undo_split_free_block() {
+    for(int i = BIG_BLKS - 1; i >= 0; i--) {heap_free(results[i]);}
+}
+
+// Splits every free block into two free halves, which stay apart while coalescing is deferred.
+static void split_pairs() {
+    for(int i = 0; i < BIG_BLKS; i++) {
+        heap_free(split_free_block(big_blks[i], HALF_SIZE, HALF_SIZE - 8));
+    }
+}
+
+static void begin_coalesce() {
+    coalesce_threshold = INT_MAX;
+    split_pairs();
+}
+
+static void end_coalesce() {
+    coalesce_heap();
+    coalesce_threshold = 0;
+}
+
+static void op_coalesce_next_blk(int i) {coalesce_next_blk(big_blks[i]);}
+static void op_coalesce_prev_blk(int i) {coalesce_prev_blk((sf_block*) ((char*) big_blks[i] + HALF_SIZE));}
+static void op_coalesce_heap(int i) {coalesce_heap();}
+
+static const struct micro micros[] = {
+    {"get_req_blk_size", PURE_BATCH, NULL, op_get_req_blk_size, NULL, NULL},
+    {"get_quick_list_idx", PURE_BATCH, NULL, op_get_quick_list_idx, NULL, NULL},
+    {"get_free_list_idx", PURE_BATCH, NULL, op_get_free_list_idx, NULL, NULL},
+    {"search_quicklists (hit)", QUICK_BLKS, NULL, op_search_quicklists_hit, undo_search_quicklists, NULL},
+    {"search_quicklists (miss)", PURE_BATCH, NULL, op_search_quicklists_miss, NULL, NULL},
+    {"search_freelists", BIG_BLKS, NULL, op_search_freelists, undo_search_freelists, NULL},
+    {"split_free_block", BIG_BLKS, NULL, op_split_free_block, undo_split_free_block, NULL},
+    {"coalesce_next_blk", BIG_BLKS, begin_coalesce, op_coalesce_next_blk, split_pairs, end_coalesce},
+    {"coalesce_prev_blk", BIG_BLKS, begin_coalesce, op_coalesce_prev_blk, split_pairs, end_coalesce},
+    {"coalesce_heap", 1, begin_coalesce, op_coalesce_heap, split_pairs, end_coalesce},
+};
+
+static int compare_u64(const void* a, const void* b) {
+    uint64_t x = *(const uint64_t*) a, y = *(const uint64_t*) b;
+    return (x > y) - (x < y);
+}
+
+static void op_empty(int i) {}
+
+// Runs the batches of a benchmark and returns the cost of each, including the clock reads, sorted.
+static void run_batches(const struct micro* micro, uint64_t* samples) {
+    if(micro->begin) {micro->begin();}
+
+    for(int s = -WARMUP; s < SAMPLES; s++) {
+        uint64_t start = ticks();
+        for(int i = 0; i < micro->batch; i++) {micro->op(i);}
+        uint64_t elapsed = ticks() - start;
+
+        if(micro->undo) {micro->undo();}
+        if(s >= 0) {samples[s] = elapsed;}
+    }
+
+    if(micro->end) {micro->end();}
+    qsort(samples, SAMPLES, sizeof(*samples), compare_u64);
+}
+
+// Returns the number of ticks per ns, measured against the monotonic clock.
+static double ticks_per_ns() {
+    uint64_t start_ns = now_ns(), start = ticks();
+    while(now_ns() - start_ns < 50000000) {}
+    return (double) (ticks() - start) / (now_ns() - start_ns);
+}
+
+int main(int argc, char const *argv[]) {
+    struct sf_arena* arena = arena_get();
+
+    uint32_t rng = 2463534242u;
+    for(int i = 0; i < PURE_BATCH; i++) {
+        req_sizes[i] = 1 + next_rand(&rng) % 4096;
+        blk_sizes[i] = get_req_blk_size(req_sizes[i]);
+    }
+
+    // Lay out the free blocks and guards, then fill the quick list.
+    for(int i = 0; i < BIG_BLKS; i++) {
+        void* big = heap_malloc(BIG_SIZE, BIG_SIZE - 8);
+        void* guard = heap_malloc(GUARD_SIZE, GUARD_SIZE - 8);
+        if(!big || !guard) {
+            fprintf(stderr, "heap setup failed\n");
+            return EXIT_FAILURE;
+        }
+        big_blks[i] = block_of(big);
+    }
+    for(int i = 0; i < BIG_BLKS; i++) {heap_free(big_blks[i]);}
+
+    void* quick[QUICK_BLKS];
+    for(int i = 0; i < QUICK_BLKS; i++) {quick[i] = heap_malloc(QUICK_SIZE, QUICK_SIZE - 8);}
+    for(int i = 0; i < QUICK_BLKS; i++) {heap_free(block_of(quick[i]));}
+
+    // The functions under test bypass the payload counters, so they are restored afterwards.
+    uint64_t payload = arena->payload, payload_blk_size = arena->payload_blk_size, peak = arena->peak_payload;
+
+    static uint64_t samples[SAMPLES];
+    struct micro empty = {"", 1, NULL, op_empty, NULL, NULL};
+    run_batches(&empty, samples);
+    uint64_t overhead = samples[SAMPLES / 2];
+    double scale = ticks_per_ns();
+
+    printf("%-26s %14s %14s %10s\n", "function", "median cycles", "min cycles", "median ns");
+    for(int m = 0; m < sizeof(micros) / sizeof(micros[0]); m++) {
+        run_batches(&micros[m], samples);
+
+        double median = samples[SAMPLES / 2] > overhead ? (double) (samples[SAMPLES / 2] - overhead) : 0.0;
+        double min = samples[0] > overhead ? (double) (samples[0] - overhead) : 0.0;
+        median /= micros[m].batch;
+        min /= micros[m].batch;
+
+        printf("%-26s %14.1f %14.1f %10.1f\n", micros[m].name, median, min, median / scale);
+    }
+
+    arena->payload = payload;
+    arena->payload_blk_size = payload_blk_size;
+    arena->peak_payload = peak;
+    arena_unlock(arena);
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,106 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+#include <sys/wait.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "bench.h"
+
+/*
+ * Runs the same randomized malloc/realloc/free workload under each placement policy and reports
+ * throughput, internal fragmentation (sampled and final), heap size and failed requests.
+ * Every policy runs in its own process so that it starts from a fresh heap.
+ */
+
+#define SLOTS       48
+#define OPS         200000
+#define SAMPLE_EVERY 64
+
+struct policy_run {
+    const char* name;
+    struct sf_placement_policy policy;
+};
+
+static const struct policy_run runs[] = {
+    {"first-fit",            {SF_FIRST_FIT, 8, 0, 0}},
+    {"first-fit addr-order", {SF_FIRST_FIT, 8, 1, 0}},
+    {"best-fit/8",           {SF_BEST_FIT, 8, 0, 0}},
+    {"best-fit/64",          {SF_BEST_FIT, 64, 0, 0}},
+    {"good-fit",             {SF_GOOD_FIT, 8, 0, 0}},
+    {"first-fit split-high", {SF_FIRST_FIT, 8, 0, 512}},
+    {"best-fit/8 addr-order split-high", {SF_BEST_FIT, 8, 1, 512}},
+};
+
+static uint32_t rng_state = 2463534242u;
+
+// Mostly small requests with a tail of medium and large ones.
+static sf_size_t next_size() {
+    uint32_t r = next_rand(&rng_state) % 100;
+    if(r < 70) {return 1 + next_rand(&rng_state) % 200;}
+    if(r < 95) {return 200 + next_rand(&rng_state) % 800;}
+    return 1000 + next_rand(&rng_state) % 2000;
+}
+
+static void run_workload(const struct policy_run* run) {
+    void* slots[SLOTS] = {0};
+    double frag_sum = 0.0;
+    int samples = 0, failed = 0;
+    long heap_max = 0;
+
+    sf_set_placement_policy(&run->policy);
+
+    double start = now_sec();
+    for(int op = 0; op < OPS; op++) {
+        int i = next_rand(&rng_state) % SLOTS;
+        if(!slots[i]) {
+            if(!(slots[i] = sf_malloc(next_size()))) {failed++;}
+        }
+        else if(next_rand(&rng_state) % 4 == 0) {
+            void* p = sf_realloc(slots[i], next_size());
+            if(p) {slots[i] = p;}
+            else {failed++;}
+        }
+        else {
+            sf_free(slots[i]);
+            slots[i] = NULL;
+        }
+
+        if(op % SAMPLE_EVERY == 0) {
+            frag_sum += sf_internal_fragmentation();
+            samples++;
+        }
+        long heap_size = (long) (sf_mem_end() - sf_mem_start());
+        if(heap_size > heap_max) {heap_max = heap_size;}
+    }
+    double elapsed = now_sec() - start;
+
+    printf("%-34s %10.2f %10.4f %10.4f %10.4f %10ld %8d\n", run->name, OPS / elapsed / 1e6,
+           frag_sum / samples, sf_internal_fragmentation(), sf_peak_utilization(), heap_max, failed);
+}
+
+int main(int argc, char const *argv[]) {
+    printf("%-34s %10s %10s %10s %10s %10s %8s\n", "policy", "Mops/s", "avg frag", "end frag",
+           "peak util", "heap max", "failed");
+
+    for(int i = 0; i < sizeof(runs) / sizeof(runs[0]); i++) {
+        fflush(stdout);
+        pid_t pid = fork();
+        if(pid == 0) {
+            run_workload(&runs[i]);
+            fflush(stdout);
+            _exit(EXIT_SUCCESS);
+        }
+
+        int status;
+        waitpid(pid, &status, 0);
+        if(!WIFEXITED(status) || WEXITSTATUS(status) != EXIT_SUCCESS) {
+            fprintf(stderr, "%s: workload did not complete\n", runs[i].name);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,54 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include "sfmm.h"
+#include "bench.h"
+
+/*
+ * Append-heavy buffers: each round grows a few buffers side by side, a chunk at a time, with
+ * sf_realloc, then frees them. Reports the time per realloc and the share of reallocs that moved
+ * the buffer, which is the share that paid for a copy.
+ */
+
+#define BUFFERS 4
+#define CHUNK   64
+#define MAX_LEN 2048    /* Leaves room in the 24 KiB sfutil heap for buffers that move. */
+#define ROUNDS  2000
+
+int main(int argc, char const *argv[]) {
+    long reallocs = 0, moves = 0, failed = 0;
+
+    double start = now_sec();
+    for(int r = 0; r < ROUNDS; r++) {
+        char* bufs[BUFFERS] = {0};
+
+        for(sf_size_t len = CHUNK; len <= MAX_LEN; len += CHUNK) {
+            // Buffers grow in turn, so a buffer usually has a neighbour that is also growing.
+            for(int i = 0; i < BUFFERS; i++) {
+                char* buf = bufs[i] ? sf_realloc(bufs[i], len) : sf_malloc(len);
+                if(!buf) {
+                    failed++;
+                    continue;
+                }
+                if(bufs[i]) {
+                    reallocs++;
+                    if(buf != bufs[i]) {moves++;}
+                }
+                memset(buf + len - CHUNK, i, CHUNK);
+                bufs[i] = buf;
+            }
+        }
+
+        for(int i = 0; i < BUFFERS; i++) {
+            if(bufs[i]) {sf_free(bufs[i]);}
+        }
+    }
+    double elapsed = now_sec() - start;
+
+    printf("%12s %12s %8s\n", "ns/realloc", "moved %", "failed");
+    printf("%12.1f %12.2f %8ld\n", elapsed / reallocs * 1e9, 100.0 * moves / reallocs, failed);
+
+    return EXIT_SUCCESS;
+}
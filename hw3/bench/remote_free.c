@@ -0,0 +1,122 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "bench.h"
+
+/*
+ * Producer/consumer benchmark: one thread allocates messages and passes them through a ring to
+ * another thread, which frees them. Reports throughput and, over all arenas, lock acquisitions
+ * per message and the share of messages that came back through a remote free stack.
+ *
+ * Built normally (make bench), every call is wrapped in one global mutex. Built with make threads,
+ * the consumer's frees are queued for the producer's arena instead of taking its lock.
+ */
+
+#define MSGS      1000000
+#define RING_SIZE 16   /* Must be a power of two. Kept small so that the messages in flight fit in one heap. */
+
+static const sf_size_t msg_sizes[] = {64, 256, 1000};
+
+static void* ring[RING_SIZE];
+static unsigned long ring_head, ring_tail;
+static sf_size_t msg_size;
+
+#ifdef SF_THREADS
+#define call_lock()
+#define call_unlock()
+#else
+static pthread_mutex_t call_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define call_lock() pthread_mutex_lock(&call_mutex)
+#define call_unlock() pthread_mutex_unlock(&call_mutex)
+#endif
+
+// Sums the lock acquisitions and remote frees of all arenas.
+static void arena_counts(uint64_t* acquisitions, uint64_t* remote_frees) {
+    *acquisitions = *remote_frees = 0;
+    for(int i = 0; i < sf_arena_count(); i++) {
+        struct sf_arena_stats stats;
+        sf_get_arena_stats(i, &stats);
+        *acquisitions += stats.lock_acquisitions;
+        *remote_frees += stats.remote_frees;
+    }
+}
+
+// Returns the number of failed allocations, cast to a pointer.
+static void* producer(void* arg) {
+    long failed = 0;
+    for(int i = 0; i < MSGS; i++) {
+        call_lock();
+        void* msg = sf_malloc(msg_size);
+        call_unlock();
+
+        if(!msg) {
+            failed++;
+            continue;
+        }
+        memset(msg, i, 8);
+
+        // Wait for room in the ring.
+        unsigned long head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+        while(head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == RING_SIZE) {sched_yield();}
+        ring[head & (RING_SIZE - 1)] = msg;
+        __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+    }
+
+    // A NULL message tells the consumer to stop.
+    unsigned long head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    while(head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == RING_SIZE) {sched_yield();}
+    ring[head & (RING_SIZE - 1)] = NULL;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+
+    return (void*) failed;
+}
+
+static void* consumer(void* arg) {
+    while(1) {
+        unsigned long tail = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+        while(__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) == tail) {sched_yield();}
+        void* msg = ring[tail & (RING_SIZE - 1)];
+        __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+        if(!msg) {break;}
+
+        call_lock();
+        sf_free(msg);
+        call_unlock();
+    }
+    return NULL;
+}
+
+int main(int argc, char const *argv[]) {
+    printf("%8s %12s %12s %12s %8s\n", "size", "Mmsgs/s", "locks/msg", "remote %", "failed");
+
+    for(int i = 0; i < sizeof(msg_sizes) / sizeof(msg_sizes[0]); i++) {
+        pthread_t threads[2];
+        void* failed;
+        uint64_t acquisitions_before, remote_before, acquisitions, remote_frees;
+
+        msg_size = msg_sizes[i];
+        arena_counts(&acquisitions_before, &remote_before);
+
+        double start = now_sec();
+        pthread_create(&threads[0], NULL, producer, NULL);
+        pthread_create(&threads[1], NULL, consumer, NULL);
+        pthread_join(threads[0], &failed);
+        pthread_join(threads[1], NULL);
+        double elapsed = now_sec() - start;
+
+        arena_counts(&acquisitions, &remote_frees);
+        acquisitions -= acquisitions_before;
+        remote_frees -= remote_before;
+
+        printf("%8u %12.2f %12.3f %12.2f %8ld\n", msg_size, MSGS / elapsed / 1e6,
+               (double) acquisitions / MSGS, 100.0 * remote_frees / MSGS, (long) failed);
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,65 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "bench.h"
+
+/*
+ * Small-object churn: keeps a pool of live objects of one size and repeatedly frees a random one
+ * and allocates a replacement. Reports the time per malloc/free pair and the memory the live
+ * objects take up, counting both the heap and any slabs, once the pool is full. Slabs are whole
+ * pages, so the footprint of a slab build goes up in steps of 4096 bytes.
+ *
+ * Built normally (make bench), every object is a heap block. Built with make slab, requests of up
+ * to 176 bytes are served from slabs. Compare the two builds' output.
+ */
+
+#define LIVE_OBJS 100  /* 100 blocks of the largest size nearly fill the 24 KiB sfutil heap. */
+#define OPS       2000000
+
+static const sf_size_t obj_sizes[] = {8, 24, 48, 100, 176};
+
+// Returns the bytes taken up by allocated heap blocks and by slabs.
+static size_t footprint() {
+    struct sf_arena_stats arena;
+    struct sf_slab_stats slab;
+    sf_get_arena_stats(0, &arena);
+    sf_get_slab_stats(&slab);
+    return arena.heap_size - arena.free_size + slab.bytes;
+}
+
+int main(int argc, char const *argv[]) {
+    printf("%8s %10s %14s %14s %8s\n", "size", "ns/op", "footprint", "bytes/object", "failed");
+
+    for(int i = 0; i < sizeof(obj_sizes) / sizeof(obj_sizes[0]); i++) {
+        sf_size_t size = obj_sizes[i];
+        void* objs[LIVE_OBJS];
+        uint32_t rng = 2463534242u;
+        long failed = 0;
+
+        size_t bytes = footprint();
+        for(int j = 0; j < LIVE_OBJS; j++) {
+            if(!(objs[j] = sf_malloc(size))) {failed++;}
+        }
+        bytes = footprint() - bytes;
+
+        double start = now_sec();
+        for(int op = 0; op < OPS; op++) {
+            int j = next_rand(&rng) % LIVE_OBJS;
+            if(objs[j]) {sf_free(objs[j]);}
+            if(!(objs[j] = sf_malloc(size))) {failed++;}
+        }
+        double elapsed = now_sec() - start;
+
+        for(int j = 0; j < LIVE_OBJS; j++) {
+            if(objs[j]) {sf_free(objs[j]);}
+        }
+
+        printf("%8u %10.1f %14zu %14.1f %8ld\n", size, elapsed / OPS * 1e9, bytes,
+               (double) bytes / LIVE_OBJS, failed);
+    }
+
+    return EXIT_SUCCESS;
+}
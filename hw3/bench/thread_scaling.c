@@ -0,0 +1,116 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <time.h>
+#include <pthread.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "bench.h"
+
+/*
+ * Measures malloc/free throughput as the number of threads grows. Each thread keeps a few live
+ * small blocks and repeatedly frees one and allocates a replacement.
+ *
+ * Built normally (make bench), the allocator is single-threaded, so every call is wrapped in one
+ * global mutex, as callers have to do. Built with make threads, the allocator is called directly
+ * and small requests are served from per-thread caches. The last column is the share of arena lock
+ * acquisitions that found the lock taken, summed over all arenas.
+ */
+
+#define MAX_THREADS 16
+#define LIVE_BLKS   4
+#define OPS         1000000  /* malloc/free pairs per thread. */
+
+static const int thread_counts[] = {1, 2, 4, 8, MAX_THREADS};
+
+static pthread_barrier_t start_barrier;
+
+#ifdef SF_THREADS
+#define call_lock()
+#define call_unlock()
+#else
+static pthread_mutex_t call_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define call_lock() pthread_mutex_lock(&call_mutex)
+#define call_unlock() pthread_mutex_unlock(&call_mutex)
+#endif
+
+// Sums the lock counters of all arenas.
+static void arena_locks(uint64_t* acquisitions, uint64_t* contentions) {
+    *acquisitions = *contentions = 0;
+    for(int i = 0; i < sf_arena_count(); i++) {
+        struct sf_arena_stats stats;
+        sf_get_arena_stats(i, &stats);
+        *acquisitions += stats.lock_acquisitions;
+        *contentions += stats.lock_contentions;
+    }
+}
+
+// Returns the number of failed allocations, cast to a pointer.
+static void* worker(void* arg) {
+    void* blks[LIVE_BLKS] = {0};
+    uint32_t rng = (uint32_t) (uintptr_t) arg * 2654435761u + 1;
+    long failed = 0;
+
+    pthread_barrier_wait(&start_barrier);
+    for(int op = 0; op < OPS; op++) {
+        int i = op % LIVE_BLKS;
+        sf_size_t size = 1 + next_rand(&rng) % 24;
+
+        call_lock();
+        if(blks[i]) {sf_free(blks[i]);}
+        blks[i] = sf_malloc(size);
+        call_unlock();
+
+        if(!blks[i]) {failed++;}
+    }
+
+    call_lock();
+    for(int i = 0; i < LIVE_BLKS; i++) {
+        if(blks[i]) {sf_free(blks[i]);}
+    }
+    call_unlock();
+
+    return (void*) failed;
+}
+
+int main(int argc, char const *argv[]) {
+    pthread_t threads[MAX_THREADS];
+
+    printf("%8s %12s %12s %8s %12s\n", "threads", "Mops/s", "per thread", "failed", "contended %");
+
+    for(int t = 0; t < sizeof(thread_counts) / sizeof(thread_counts[0]); t++) {
+        int n = thread_counts[t];
+        long failed = 0;
+        uint64_t acquisitions_before, contentions_before, acquisitions, contentions;
+        arena_locks(&acquisitions_before, &contentions_before);
+
+        pthread_barrier_init(&start_barrier, NULL, n + 1);
+        for(int i = 0; i < n; i++) {
+            if(pthread_create(&threads[i], NULL, worker, (void*) (uintptr_t) (i + 1))) {
+                fprintf(stderr, "pthread_create failed\n");
+                return EXIT_FAILURE;
+            }
+        }
+
+        pthread_barrier_wait(&start_barrier);
+        double start = now_sec();
+        for(int i = 0; i < n; i++) {
+            void* thread_failed;
+            pthread_join(threads[i], &thread_failed);
+            failed += (long) thread_failed;
+        }
+        double elapsed = now_sec() - start;
+        pthread_barrier_destroy(&start_barrier);
+
+        arena_locks(&acquisitions, &contentions);
+        acquisitions -= acquisitions_before;
+        contentions -= contentions_before;
+
+        // Each iteration is one malloc and one free.
+        double mops = 2.0 * OPS * n / elapsed / 1e6;
+        printf("%8d %12.2f %12.2f %8ld %12.2f\n", n, mops, mops / n, failed,
+               acquisitions ? 100.0 * contentions / acquisitions : 0.0);
+    }
+
+    return EXIT_SUCCESS;
+}
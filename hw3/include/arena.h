@@ -0,0 +1,139 @@
+#ifndef ARENA_H
+#define ARENA_H
+
+/*
+ * Arenas. An arena is an independent heap with its own quick lists, free lists, prologue, epilogue
+ * and growth region. The helper functions operate on the arena cur_arena points to.
+ *
+ * Arena 0 is the heap described in sfmm.h: its lists are sf_quick_lists and sf_free_list_heads, and
+ * its memory comes from sf_mem_grow(). A single-threaded build only has arena 0.
+ *
+ * A threaded build (SF_THREADS) has SF_ARENAS arenas, each behind its own lock. Arenas 1 and up are
+ * laid out in one reservation of SF_ARENA_SIZE bytes per arena, made with mmap on first use, and
+ * each grows a page at a time within its part of it, like sf_mem_grow(). A thread is assigned an
+ * arena round-robin the first time it needs one. When it later finds that arena locked, it moves to
+ * the first other arena that is not. Blocks carry no spare header bits, so a block's arena is found
+ * from its address, and it is always freed to that arena.
+ *
+ * A thread that frees a block of another thread's arena does not take that arena's lock. Instead it
+ * pushes the block onto the arena's remote free stack, a lock-free list linked through
+ * body.links.next. Whichever thread next locks the arena, usually its owner on its next sf_malloc,
+ * takes the whole stack in one exchange and frees the blocks. Until then, they count as allocated.
+ *
+ * Pages of arenas 1 and up come straight from the reservation, so they read as zero the first time
+ * they are used. Such an arena keeps a clean mark: its heap is zero from the mark up to the footer
+ * of its last block, which lies in the wilderness. sf_calloc only clears the part of a block below
+ * it. Handing out a block raises the mark past the block and the header and links of the block
+ * after it. Arena 0's pages come from sfutil, which takes them from malloc, so its mark stays above
+ * the heap.
+ */
+
+#ifdef TLSF
+#include "tlsf.h"
+#endif
+
+#ifdef SF_THREADS
+#include <pthread.h>
+
+#ifndef SF_ARENAS
+#define SF_ARENAS 4
+#endif
+// The most each of arenas 1 and up can grow to: 64 KiB by default, against the fixed heap sfutil gives arena 0. The
+// reservation is made with MAP_NORESERVE, so a larger size only costs address space. A request an arena cannot hold
+// is tried in the other arenas, and fails with ENOMEM only once every arena in use is out of memory.
+#ifndef SF_ARENA_SIZE
+#define SF_ARENA_SIZE (64 * PAGE_SZ)
+#endif
+
+#define ARENA_LOCAL __thread
+#else
+#undef SF_ARENAS
+#define SF_ARENAS 1
+#define ARENA_LOCAL
+#endif
+
+struct sf_arena {
+    int index;
+    __typeof__(sf_quick_lists[0])* quick_lists;
+    sf_block* free_list_heads;
+    uint32_t free_list_bitmap;  // Bit i is set if and only if free list i is non-empty.
+    uint32_t last_grow_pages;   // Number of pages acquired by the most recent grow event.
+    uint32_t quick_list_capacity[NUM_QUICK_LISTS];  // Blocks each quick list may hold before it is flushed.
+    uint32_t quick_list_hits[NUM_QUICK_LISTS];      // Since the last adaptation: lookups that found a block,
+    uint32_t quick_list_misses[NUM_QUICK_LISTS];    // lookups that found the list empty,
+    uint32_t quick_list_flushes[NUM_QUICK_LISTS];   // and insertions that found it full.
+    uint32_t quick_list_ops;    // Lookups and insertions since the last adaptation.
+    uint32_t pending_frees;     // Frees whose blocks have not been coalesced yet.
+    void* clean;                // Heap memory from here up to the last footer has never been written.
+    uint64_t payload;           // Total payload of allocated blocks.
+    uint64_t payload_blk_size;  // Total size of allocated blocks.
+    uint64_t peak_payload;      // Highest total payload so far.
+
+    // Totals since the arena was created, reported by sf_get_stats.
+    uint64_t quick_list_hit_count[NUM_QUICK_LISTS];
+    uint64_t quick_list_miss_count[NUM_QUICK_LISTS];
+    uint64_t quick_list_flush_count[NUM_QUICK_LISTS];
+    uint64_t splits;
+    uint64_t coalesces;
+    uint64_t grows;
+#ifdef TLSF
+    uint32_t tlsf_fl_bitmap;    // Bit i is set if list i has any non-empty range.
+    uint32_t tlsf_sl_bitmap[NUM_FREE_LISTS];  // Bit j of entry i is set if range j of list i is non-empty.
+    sf_block* tlsf_heads[NUM_FREE_LISTS][TLSF_SL_COUNT];  // First block of each range, or NULL.
+#endif
+#ifdef SF_THREADS
+    pthread_mutex_t lock;
+    int threads;                // Threads currently assigned to the arena.
+    uint64_t lock_acquisitions;
+    uint64_t lock_contentions;
+    sf_block* remote_frees;     // Blocks freed by other threads, not yet returned to the lists.
+    uint64_t remote_free_count; // Blocks that came back through remote_frees.
+
+    // Heap bounds and list storage of arenas other than arena 0.
+    void* start;
+    void* end;
+    void* limit;
+    __typeof__(sf_quick_lists[0]) own_quick_lists[NUM_QUICK_LISTS];
+    sf_block own_free_list_heads[NUM_FREE_LISTS];
+#endif
+};
+
+extern struct sf_arena arenas[SF_ARENAS];
+extern ARENA_LOCAL struct sf_arena* cur_arena;
+extern int arena_limit;
+
+struct sf_arena* arena_of(void* ptr);
+
+#ifdef SF_THREADS
+
+struct sf_arena* arena_get();
+void arena_lock(struct sf_arena* arena);
+void arena_unlock(struct sf_arena* arena);
+void arena_lock_all();
+void arena_unlock_all();
+int arena_is_remote(struct sf_arena* arena);
+void arena_remote_free(struct sf_arena* arena, sf_block* blk);
+
+void* arena_mem_start(struct sf_arena* arena);
+void* arena_mem_end(struct sf_arena* arena);
+void* arena_mem_grow(struct sf_arena* arena);
+int arena_mem_zeroed(struct sf_arena* arena);
+
+#else
+
+#define arena_get() (cur_arena)
+#define arena_lock(ARENA) ((void) (ARENA))
+#define arena_unlock(ARENA) ((void) (ARENA))
+#define arena_lock_all()
+#define arena_unlock_all()
+#define arena_is_remote(ARENA) 0
+#define arena_remote_free(ARENA, BLK)
+
+#define arena_mem_start(ARENA) sf_mem_start()
+#define arena_mem_end(ARENA) sf_mem_end()
+#define arena_mem_grow(ARENA) sf_mem_grow()
+#define arena_mem_zeroed(ARENA) 0
+
+#endif
+
+#endif
@@ -85,4 +85,37 @@
 #define error(S, ...)
 #endif
 
+/*
+ * Allocator trace points. In a build with TRACE defined (the debug target), every event is
+ * recorded into an in-memory ring buffer that holds the most recent TRACE_RING_SIZE events and
+ * can be dumped with sf_trace_dump(). Otherwise trace() expands to nothing, so release builds
+ * pay no cost for the trace points left on the allocation paths. A threaded build (SF_THREADS)
+ * keeps one ring per thread, and sf_trace_dump() prints the calling thread's ring.
+ */
+typedef enum {
+  TRACE_MALLOC,   /* a: requested size,       b: returned payload address */
+  TRACE_FREE,     /* a: payload address,      b: block size               */
+  TRACE_SPLIT,    /* a: block address,        b: size of the lower block  */
+  TRACE_COALESCE, /* a: merged block address, b: merged block size        */
+  TRACE_FLUSH,    /* a: quick list index,     b: number of blocks flushed */
+  TRACE_GROW,     /* a: new page address,     b: number of bytes added    */
+  NUM_TRACE_EVENTS
+} trace_event;
+
+#ifdef TRACE
+#include <stdint.h>
+
+#define TRACE_RING_SIZE 4096 /* Must be a power of two. */
+
+void sf_trace_record(trace_event event, uint64_t a, uint64_t b);
+void sf_trace_dump(FILE *out);
+
+#define trace(EVENT, A, B)                                                     \
+  do {                                                                         \
+    sf_trace_record((EVENT), (uint64_t)(A), (uint64_t)(B));                    \
+  } while (0)
+#else
+#define trace(EVENT, A, B)
+#endif
+
 #endif /* DEBUG_H */
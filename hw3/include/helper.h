@@ -1,39 +1,111 @@
 #ifndef HELPER_H
 #define HELPER_H
 
+extern struct sf_placement_policy placement_policy;
+extern double growth_factor;
+extern struct sf_quick_list_config quick_list_config;
+extern int coalesce_threshold;
+
 void* safe_sf_mem_grow();
 int init_heap();
-int add_mem_page();
+sf_block* grow_heap(uint32_t blk_size);
+
+// The key headers and footers are stored XORed with. It is read from sfutil once, by init_hdr_magic, so that accessing
+// a header costs no call. The fast build (SF_FAST) stores headers in the clear, so there the XORs compile away.
+#ifdef SF_FAST
+#define HDR_MAGIC ((sf_header) 0)
+#else
+extern sf_header hdr_magic;
+#define HDR_MAGIC hdr_magic
+#endif
+
+void init_hdr_magic();
 
 uint32_t get_req_blk_size(sf_size_t size);
-uint64_t get_prev_blk_size(sf_block* blk);
-uint64_t get_blk_size(sf_block* blk);
-uint64_t get_payload_size(sf_block* blk);
-void add_blk_sizes(sf_block* blk, uint64_t blk_size, uint64_t payload_size);
-void clear_blk_sizes(sf_block* blk);
-void clear_payload_size(sf_block* blk);
-uint64_t get_prev_info_bits(sf_block* blk);
-uint64_t get_info_bits(sf_block* blk);
-void add_info_bits(sf_block* blk, int info);
-void clear_info_bits(sf_block* blk);
+
+// Header accessors. They are inline, as nearly every heap operation decodes or sets several headers.
+
+// Returns the size of the previous block, from its footer.
+static inline uint64_t get_prev_blk_size(sf_block* blk) {
+    return (blk->prev_footer ^ HDR_MAGIC) & 0x00000000FFFFFFF0;
+}
+
+// Returns the size of a valid block.
+static inline uint64_t get_blk_size(sf_block* blk) {
+    return (blk->header ^ HDR_MAGIC) & 0x00000000FFFFFFF0;
+}
+
+// Returns the payload size of a valid block.
+static inline uint64_t get_payload_size(sf_block* blk) {
+    return ((blk->header ^ HDR_MAGIC) & 0xFFFFFFFF00000000) >> 32;
+}
+
+// Returns the info bits of the previous block.
+static inline uint64_t get_prev_info_bits(sf_block* blk) {
+    return (blk->prev_footer ^ HDR_MAGIC) & 0x000000000000000F;
+}
+
+// Returns the info bits of a valid block.
+static inline uint64_t get_info_bits(sf_block* blk) {
+    return (blk->header ^ HDR_MAGIC) & 0x000000000000000F;
+}
+
+// Returns the decoded header of a block, loaded once with an atomic load. In a threaded build, the free paths read the
+// header of a block they own without its arena's lock, while the lock holder may set or clear the block's prev_alloc
+// bit, so they decode this one value and rely only on its size and alloc bits.
+static inline uint64_t load_blk_header(sf_block* blk) {
+    return __atomic_load_n(&blk->header, __ATOMIC_RELAXED) ^ HDR_MAGIC;
+}
+
+// Sets the whole header field of a block, composed from its parts, in one store.
+static inline void set_blk_header(sf_block* blk, uint64_t blk_size, uint64_t payload_size, uint64_t info) {
+    blk->header = ((payload_size << 32) | blk_size | info) ^ HDR_MAGIC;
+}
+
+// Sets info bits of header field of a valid block (3 lsb's).
+static inline void add_info_bits(sf_block* blk, int info) {
+    blk->header = ((blk->header ^ HDR_MAGIC) | info) ^ HDR_MAGIC;
+}
+
+// Clears the info bits of header field of a valid block that are not in mask.
+static inline void keep_info_bits(sf_block* blk, uint64_t mask) {
+    blk->header = ((blk->header ^ HDR_MAGIC) & (0xFFFFFFFFFFFFFFF0 | mask)) ^ HDR_MAGIC;
+}
 
 int get_quick_list_idx(uint32_t size);
 void init_quick_lists();
 void add_quick_list_blk(sf_block* blk, uint32_t size);
-void flush_quicklist(int index);
+void apply_quick_list_config();
+void flush_quicklist(int index, int count);
 void* search_quicklists(uint32_t blk_size, uint32_t payload_size);
 
 int get_free_list_idx(uint32_t size);
+int get_free_list_fit_idx(uint32_t size);
 void init_free_lists();
 void add_free_list_blk(sf_block* blk, uint32_t size);
 void delete_free_list_blk(sf_block* blk, uint32_t size);
 void relocate_free_list_blk(sf_block* blk, uint32_t old_size, uint32_t new_size);
+sf_block* find_free_list_fit(uint32_t blk_size);
 void* search_freelists(uint32_t size, uint32_t payload_size);
+void alloc_free_block(sf_block* blk, uint32_t payload_size);
+void* search_aligned_freelists(uint32_t blk_size, uint32_t payload_size, uint32_t align);
+
+// Central heap entry points, defined in sfmm.c.
+void* heap_malloc(uint32_t blk_size, sf_size_t size);
+void* heap_calloc(uint32_t blk_size, sf_size_t size);
+void* heap_memalign(uint32_t blk_size, sf_size_t size, uint32_t align);
+int heap_malloc_batch(uint32_t blk_size, sf_size_t size, int count, void** out);
+void heap_free(sf_block* blk);
+void heap_free_run(sf_block* blk, int count);
 
 int validate_block(void* ptr);
-void split_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size);
+sf_block* split_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size);
+sf_block* split_free_block_high(sf_block* blk, uint32_t blk_size, uint32_t payload_size);
+int carve_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size, int count, void** out);
 void split_alloc_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size);
+int grow_alloc_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size);
 sf_block* coalesce_prev_blk(sf_block* blk);
 void coalesce_next_blk(sf_block* blk);
+void coalesce_heap();
 
 #endif
\ No newline at end of file
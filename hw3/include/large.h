@@ -0,0 +1,31 @@
+#ifndef LARGE_H
+#define LARGE_H
+
+/*
+ * Large allocations. Requests of more than large_threshold bytes (SF_MMAP_THRESHOLD at compile
+ * time, changed with sf_set_mmap_threshold) bypass the heap: each one gets its own anonymous
+ * mapping, which starts with a LARGE_HDR_SIZE-byte header followed by the payload. Freeing one
+ * unmaps it at once, and resizing it uses mremap, so the kernel moves the pages instead of copying.
+ *
+ * A large payload is the only kind that starts LARGE_HDR_SIZE bytes into a page, or at a page
+ * boundary, outside every arena and the slabs, which is how sf_free and sf_realloc recognise one.
+ * Payloads aligned to more than LARGE_HDR_SIZE bytes start a page, and their header ends the page
+ * before it. That page need not be mapped for an invalid pointer, so these payloads are also kept
+ * in a table, and one that is not found there is rejected without reading its header. The header
+ * holds a magic number tied to its address, so a pointer that merely looks like a large payload
+ * is rejected.
+ * Large blocks are not counted by sf_internal_fragmentation() and sf_peak_utilization().
+ */
+
+#define LARGE_HDR_SIZE 32
+
+extern size_t large_threshold;
+
+int large_owns(void* ptr);
+void* large_malloc(sf_size_t size);
+void* large_memalign(sf_size_t size, sf_size_t align);
+int large_free(void* ptr);
+void* large_realloc(void* ptr, sf_size_t rsize);
+size_t large_usable_size(void* ptr);
+
+#endif
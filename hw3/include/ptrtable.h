@@ -0,0 +1,33 @@
+#ifndef PTRTABLE_H
+#define PTRTABLE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+/*
+ * Hash tables from addresses to 32-bit values, used by parts of the allocator that must not call
+ * an allocator themselves. The slots are mapped with mmap. Collisions are resolved by linear
+ * probing, and a removal shifts later entries of its probe run back instead of leaving a
+ * tombstone, so a NULL key marks an empty slot and NULL cannot be stored. A table does no locking
+ * of its own.
+ */
+
+struct ptrtable_slot {
+    void* key;
+    uint32_t value;
+};
+
+struct ptrtable {
+    struct ptrtable_slot* slots;    // NULL until the table is mapped.
+    size_t size;                    // Number of slots, a power of two.
+    size_t used;                    // Slots holding a key.
+};
+
+int ptrtable_map(struct ptrtable* table, size_t size);
+void ptrtable_unmap(struct ptrtable* table);
+int ptrtable_grow(struct ptrtable* table);
+int ptrtable_insert(struct ptrtable* table, void* key, uint32_t value);
+int ptrtable_find(struct ptrtable* table, void* key, uint32_t* value);
+int ptrtable_remove(struct ptrtable* table, void* key, uint32_t* value);
+
+#endif
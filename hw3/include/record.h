@@ -0,0 +1,63 @@
+#ifndef RECORD_H
+#define RECORD_H
+
+#include <stdint.h>
+
+/*
+ * Allocation recorder. Between sf_record_start() and sf_record_stop(), every completed sf_malloc,
+ * sf_realloc and sf_free is appended to a binary trace file, which sfmm_replay (make replay) plays
+ * back. Calls made by the allocator itself, such as the sf_malloc inside a moving sf_realloc, are
+ * part of the outer event and are not recorded.
+ *
+ * A trace is a record_header followed by one record_entry per event. Objects are numbered in
+ * allocation order from 0, and keep their id across reallocs. Entries are collected in a buffer
+ * and written RECORD_BUFFER bytes at a time. The recorder maps live payload addresses to ids with
+ * a ptrtable, whose slots are mapped with mmap, so it never calls an allocator. In a threaded
+ * build, events are serialised by one lock, and an event is written once its call has returned.
+ *
+ * When not recording, each call pays for one load of record_on.
+ */
+
+#define RECORD_MAGIC "SFTRACE1"
+#define RECORD_VERSION 1
+#define RECORD_BUFFER 65536
+
+#define RECORD_NO_ID UINT32_MAX
+
+typedef enum {
+    RECORD_MALLOC,      // size: requested size. The object is new.
+    RECORD_REALLOC,     // size: requested size. A size of 0 frees the object.
+    RECORD_FREE         // size: 0.
+} record_op;
+
+struct record_header {
+    char magic[8];      // RECORD_MAGIC, without its terminator.
+    uint32_t version;
+    uint32_t entry_size;
+};
+
+struct record_entry {
+    uint32_t id;        // Object id.
+    uint32_t size;
+    uint32_t delta;     // Nanoseconds since the previous event, or since recording started. Saturates at UINT32_MAX.
+    uint8_t op;         // A record_op.
+    uint8_t failed;     // Nonzero if the call returned NULL.
+    uint8_t pad[2];
+};
+
+extern int record_on;
+
+#define record_active() (__atomic_load_n(&record_on, __ATOMIC_RELAXED) && !record_paused)
+
+#ifdef SF_THREADS
+extern __thread int record_paused;
+#else
+extern int record_paused;
+#endif
+
+void record_malloc(uint32_t size, void* ptr);
+void record_free(void* ptr);
+uint32_t record_realloc_begin(void* ptr);
+void record_realloc_end(uint32_t id, void* old_ptr, uint32_t size, void* new_ptr);
+
+#endif
@@ -0,0 +1,256 @@
+#ifndef SFMM_EXT_H
+#define SFMM_EXT_H
+
+/*
+ * Extensions to the interface in sfmm.h. That header is fixed, so additional public types,
+ * constants and prototypes live here. Include it after sfmm.h.
+ */
+
+/*
+ * Aligned allocation. Returns a pointer to size bytes whose address is a multiple of align, which
+ * must be a power of two, or NULL with sf_errno set to EINVAL if it is not. Alignments of up to 16
+ * are those of every payload. For larger ones, the aligned block is carved out of a free block, and
+ * the bytes before and after it go back to the free lists, so the heap spends no more than
+ * sf_malloc would on the block itself. Requests above the mmap threshold get a mapping whose
+ * payload starts a page, after one page for its header. The result is freed with sf_free and
+ * resized with sf_realloc like any other. A block that sf_realloc moves keeps only 16-byte
+ * alignment, or page alignment for a large block. sf_aligned_alloc is the same as sf_memalign.
+ */
+void *sf_memalign(sf_size_t align, sf_size_t size);
+void *sf_aligned_alloc(sf_size_t align, sf_size_t size);
+
+/*
+ * Zeroed allocation. Returns a pointer to count * size bytes set to zero, or NULL with sf_errno set
+ * to ENOMEM if the product does not fit in sf_size_t. Memory that has never been written is not
+ * cleared again: large blocks are fresh mappings, and an arena whose pages come zeroed from mmap
+ * tracks how much of its wilderness it has never handed out (see arena.h). Everything else, which
+ * includes all of arena 0, is cleared with memset.
+ */
+void *sf_calloc(sf_size_t count, sf_size_t size);
+
+/*
+ * Batch allocation. sf_malloc_batch allocates count blocks of size bytes and stores them in out.
+ * Heap blocks are taken from the quick list of their size first, and the rest are carved one after
+ * another out of as few free blocks as possible, in a single pass under one lock. It returns the
+ * number allocated, which is less than count only if memory ran out, with sf_errno set to ENOMEM.
+ *
+ * sf_free_batch frees count blocks, however they were allocated. It sorts ptrs by address, so the
+ * order of the array is not kept. Blocks that lie next to each other in the heap are merged into
+ * one block, which is freed and coalesced with its neighbours once, instead of once per block,
+ * bypassing the thread cache. An invalid or repeated pointer aborts the program, as with sf_free.
+ */
+int sf_malloc_batch(sf_size_t size, int count, void **out);
+void sf_free_batch(void **ptrs, int count);
+
+/*
+ * Sized deallocation. Frees ptr like sf_free, given the size it was requested with, or last resized
+ * to with sf_realloc; for sf_calloc, that is count * size. The block size is computed from size, and
+ * the header is decoded once to confirm it instead of being validated in full. A block whose header
+ * disagrees, such as one that absorbed a splinter, is freed as sf_free would. A wrong size is
+ * otherwise not detected, except in a hardened build (make hardened), which validates every
+ * pointer and aborts the program if size is not the one the block was allocated for.
+ */
+void sf_free_sized(void *ptr, sf_size_t size);
+
+/*
+ * Placement policies.
+ *
+ * SF_FIRST_FIT  Scan the free list the request falls in for the first block that fits, then take
+ *               the first block of the next non-empty list. This is the default.
+ * SF_BEST_FIT   Examine up to best_fit_candidates blocks that fit, lowest list first, and take the
+ *               smallest. The scan stops early on an exact fit.
+ * SF_GOOD_FIT   Take the first block of the lowest list whose blocks are all large enough, only
+ *               scanning the request's own list when no such block exists.
+ */
+typedef enum {
+    SF_FIRST_FIT,
+    SF_BEST_FIT,
+    SF_GOOD_FIT
+} sf_fit_policy;
+
+struct sf_placement_policy {
+    sf_fit_policy fit;          // How a free block is chosen for a request.
+    int best_fit_candidates;    // Number of fitting blocks examined by SF_BEST_FIT.
+    int address_ordered;        // If nonzero, free lists are kept in address order instead of LIFO order.
+    sf_size_t split_high_min;   // Blocks of at least this size are carved from the top of a free block (0 disables).
+};
+
+/*
+ * Sets the placement policy. It can be called at any time. Address ordering only applies to blocks
+ * inserted after the call. The initial policy comes from the SF_POLICY_* compile-time settings.
+ * In a TLSF build, the fit and ordering settings are ignored because TLSF defines its own, but
+ * split_high_min still applies.
+ */
+void sf_set_placement_policy(const struct sf_placement_policy *policy);
+
+/*
+ * Copies the placement policy currently in effect into policy.
+ */
+void sf_get_placement_policy(struct sf_placement_policy *policy);
+
+/*
+ * Sets the heap growth factor. When no free block fits a request, the heap is extended by the
+ * number of pages the request needs. After the first grow event, each grow event acquires at
+ * least factor times as many pages as the previous one. A factor of 1 (the default, set with
+ * SF_GROWTH_FACTOR at compile time) disables geometric growth. Factors below 1 are treated as 1.
+ */
+void sf_set_growth_factor(double factor);
+
+/*
+ * Sets the mmap threshold. Requests of more than threshold bytes get an anonymous mapping of their
+ * own instead of a heap block. The mapping is unmapped as soon as the block is freed, and resized
+ * with mremap by sf_realloc. A heap block reallocated above the threshold moves to a mapping, and
+ * a mapped block reallocated to the threshold or below moves to the heap if it has room. The
+ * default is 128 KiB (SF_MMAP_THRESHOLD at compile time). A threshold of 0 disables direct mapping.
+ */
+void sf_set_mmap_threshold(size_t threshold);
+
+/*
+ * Sets the deferred coalescing threshold. By default (0, or SF_COALESCE_THRESHOLD at compile time),
+ * a block freed to the free lists is merged with its free neighbours immediately. With a positive
+ * threshold, freed blocks are only marked free, and an arena merges all of its adjacent free blocks
+ * in one sweep in address order once threshold frees are pending, or when no free block fits a
+ * request. Setting the threshold back to 0 merges all pending blocks. Negative values are treated as 0.
+ */
+void sf_set_coalesce_threshold(int threshold);
+
+/*
+ * Quick lists. List i holds freed blocks of 32 + 16 * i bytes for reuse by requests of exactly
+ * that size. By default all NUM_QUICK_LISTS lists are used, each holds up to QUICK_LIST_MAX
+ * blocks, and a list that overflows is flushed entirely, as described in sfmm.h.
+ *
+ * With adaptive capacities, each arena tracks how every list is used. Periodically, a list that
+ * overflowed and later found itself empty doubles its capacity, up to max_capacity, and a list that
+ * served no requests halves it, down to min_capacity, returning its excess blocks to the free lists.
+ */
+struct sf_quick_list_config {
+    int lists;                  // Number of lists in use, from the smallest size up (0 to NUM_QUICK_LISTS).
+    int adaptive;               // If nonzero, capacities adapt to use. Otherwise every list holds QUICK_LIST_MAX blocks.
+    int min_capacity;           // Bounds on adaptive capacities.
+    int max_capacity;
+    int flush_percent;          // Percentage of a full list's blocks flushed when it overflows, oldest first (at least one).
+};
+
+/*
+ * Sets the quick list configuration. It can be called at any time: blocks in lists that are no
+ * longer in use, or beyond their list's capacity, are returned to the free lists. The initial
+ * configuration comes from the SF_QUICK_LIST* compile-time settings. Out-of-range values are clamped.
+ */
+void sf_set_quick_list_config(const struct sf_quick_list_config *config);
+
+/*
+ * Copies the quick list configuration currently in effect into config.
+ */
+void sf_get_quick_list_config(struct sf_quick_list_config *config);
+
+/*
+ * Arenas. A threaded build (make threads) splits the heap into SF_ARENAS independent arenas, each
+ * with its own lock, and spreads threads across them. Other builds have a single arena, numbered 0.
+ * Arena 0 is the heap sfutil provides. Each other arena can grow to SF_ARENA_SIZE bytes (64 KiB
+ * unless set at build time). A request its thread's arena cannot hold is tried in the other arenas
+ * before sf_errno is set to ENOMEM.
+ */
+struct sf_arena_stats {
+    int threads;                // Threads currently assigned to the arena.
+    uint64_t lock_acquisitions; // Times the arena's lock was taken.
+    uint64_t lock_contentions;  // Times a thread found the arena's lock already taken.
+    uint64_t remote_frees;      // Blocks freed by other threads without taking the arena's lock.
+    size_t heap_size;           // Bytes the arena's heap has grown to.
+    size_t free_size;           // Bytes in free blocks, including blocks in quick lists.
+};
+
+/*
+ * Returns the number of arenas.
+ */
+int sf_arena_count();
+
+/*
+ * Sets how many arenas threads are assigned to, from 1 to sf_arena_count(), which is the default.
+ * Values outside that range are clamped. A thread in an arena past the new count moves to another
+ * arena on its next trip to the heap. A high lock_contentions count relative to lock_acquisitions
+ * suggests more arenas are needed.
+ */
+void sf_set_arena_count(int count);
+
+/*
+ * Copies the statistics of the given arena into stats. Returns 0 on success, or -1 if there is no
+ * arena with that index.
+ */
+int sf_get_arena_stats(int index, struct sf_arena_stats *stats);
+
+/*
+ * Allocator statistics, summed over all arenas. Counts are totals since the program started.
+ * Blocks held in thread caches count as allocated, and slab slots and directly mapped blocks are
+ * not included.
+ */
+struct sf_stats {
+    struct {
+        uint64_t hits;          // Requests served from the list.
+        uint64_t misses;        // Requests of the list's size that found it empty.
+        uint64_t flushes;       // Frees that found the list full and flushed blocks from it.
+        int length;             // Blocks currently in the list.
+    } quick_lists[NUM_QUICK_LISTS];
+    struct {
+        size_t length;          // Blocks currently in the list.
+        size_t bytes;           // Total size of those blocks.
+    } free_lists[NUM_FREE_LISTS];
+    uint64_t splits;            // Blocks split in two.
+    uint64_t coalesces;         // Pairs of free blocks merged.
+    uint64_t grows;             // Times the heap was extended after its first page.
+    size_t requested_bytes;     // Payload of allocated blocks, as requested.
+    size_t in_use_bytes;        // Size of allocated blocks, including headers and padding.
+    size_t heap_bytes;          // Size of the heap.
+};
+
+/*
+ * Copies the current statistics into stats. The free lists are walked, so this takes time
+ * proportional to the number of free blocks.
+ */
+void sf_get_stats(struct sf_stats *stats);
+
+/*
+ * Writes the current statistics to the file at path in the Prometheus text exposition format.
+ * The file is written under a temporary name and renamed into place, so a reader never sees a
+ * partial file. Returns 0 on success, or -1 if the file could not be written.
+ */
+int sf_write_stats(const char *path);
+
+/*
+ * Writes the statistics to the file at path with sf_write_stats() at most every interval_ms
+ * milliseconds, from within allocator calls. The time is checked every few hundred calls, so a
+ * program that stops calling the allocator stops updating the file. A NULL path or an interval
+ * of 0 stops the export.
+ */
+void sf_set_stats_export(const char *path, unsigned interval_ms);
+
+/*
+ * Starts recording every sf_malloc, sf_realloc and sf_free call to a binary trace file at path,
+ * which is created or truncated. Each event holds its operation, size, an object id and the time
+ * since the previous event. sfmm_replay (make replay) plays a trace back. Returns 0 on success, or
+ * -1 if a recording is already in progress or the file cannot be created. A recording still in
+ * progress at exit is completed then.
+ */
+int sf_record_start(const char *path);
+
+/*
+ * Stops recording and completes the trace file. Returns 0 on success, or -1 if nothing was being
+ * recorded or the file could not be completed.
+ */
+int sf_record_stop();
+
+/*
+ * Slabs. A slab build (make slab) serves small requests from slabs of equal-size slots instead of
+ * the heap. In other builds, all counts are 0.
+ */
+struct sf_slab_stats {
+    size_t slabs;           // Slabs holding at least one allocated slot, or kept for reuse by their class.
+    size_t slots;           // Allocated slots.
+    size_t bytes;           // Bytes of memory taken up by those slabs.
+};
+
+/*
+ * Copies the slab statistics into stats.
+ */
+void sf_get_slab_stats(struct sf_slab_stats *stats);
+
+#endif
@@ -0,0 +1,54 @@
+#ifndef SLAB_H
+#define SLAB_H
+
+/*
+ * Slab allocator for small requests, enabled by building with SF_SLAB defined (make slab).
+ *
+ * Requests of up to SLAB_MAX_SIZE bytes are served from slabs instead of the heap. A slab is one
+ * SLAB_SIZE-byte page holding a short header followed by equal-size slots, one size class per slab.
+ * Slot sizes are the request size rounded up to 16 bytes, so a 1-byte request uses 16 bytes instead
+ * of a 32-byte block. The header holds a bitmap with one bit per slot that is set while the slot is
+ * allocated, so slots carry no header of their own, and freeing a slot needs no boundary tag work.
+ *
+ * Slabs are carved from one SF_SLAB_REGION-byte reservation made with mmap on first use. It is
+ * aligned to SLAB_SIZE, so the slab of an address is found by masking it, and addresses in the
+ * reservation are told apart from heap addresses by a range check. Each class keeps a list of slabs
+ * with free slots. A slab that becomes empty is kept if it is the class's only partial slab, and is
+ * otherwise returned to a pool shared by all classes. When the reservation is used up, requests
+ * fall back to the heap.
+ *
+ * A slot's payload size is not recorded. sf_internal_fragmentation() and sf_peak_utilization()
+ * describe the heap only. In a threaded build, the slabs are shared by all threads behind one lock.
+ *
+ * In other builds, the functions below compile away.
+ */
+
+#ifdef SF_SLAB
+
+#define SLAB_SIZE 4096
+#define SLAB_MAX_SIZE 176
+#define SLAB_CLASSES (SLAB_MAX_SIZE / 16)
+
+#ifndef SF_SLAB_REGION
+#define SF_SLAB_REGION (256 * SLAB_SIZE)
+#endif
+
+int slab_owns(void* ptr);
+void* slab_malloc(sf_size_t size);
+int slab_free(void* ptr);
+void* slab_realloc(void* ptr, sf_size_t rsize);
+sf_size_t slab_usable_size(void* ptr);
+void slab_stats(size_t* slabs, size_t* slots);
+
+#else
+
+#define slab_owns(PTR) 0
+#define slab_malloc(SIZE) NULL
+#define slab_free(PTR) 0
+#define slab_realloc(PTR, RSIZE) NULL
+#define slab_usable_size(PTR) 0
+#define slab_stats(SLABS, SLOTS) (*(SLABS) = *(SLOTS) = 0)
+
+#endif
+
+#endif
@@ -0,0 +1,15 @@
+#ifndef STATS_H
+#define STATS_H
+
+/*
+ * Periodic statistics export. stats_tick() is called at the start of sf_malloc and sf_free, with no
+ * arena locked. Once an export is set up with sf_set_stats_export(), every STATS_TICK_CHECK calls
+ * it checks the time and, if the interval has passed, writes the statistics file. A threaded build
+ * counts calls per thread, and only one thread writes the file per interval.
+ */
+
+#define STATS_TICK_CHECK 256
+
+void stats_tick();
+
+#endif
@@ -0,0 +1,42 @@
+#ifndef TCACHE_H
+#define TCACHE_H
+
+/*
+ * Thread-safe mode, enabled by building with SF_THREADS defined (make threads).
+ *
+ * The heap is split into arenas (see arena.h), each protected by its own lock. In front of them,
+ * every thread keeps a private cache of blocks in the quick list size range, one LIFO list per quick
+ * list size. A request of one of those sizes is served from, and freed to, the calling thread's
+ * cache without taking a lock or using any atomic instruction. An empty list is refilled with
+ * SF_TCACHE_BATCH blocks in one trip to the thread's arena. A list that grows past SF_TCACHE_MAX
+ * blocks, or a cache that grows past SF_TCACHE_BYTES bytes, drains SF_TCACHE_BATCH blocks back to
+ * the arenas they came from; the byte limit keeps idle caches from starving the small heaps. A
+ * thread's remaining blocks are returned when it exits, or when no arena can satisfy one of its
+ * requests.
+ *
+ * Cached blocks look allocated to their arena, and the fast path never writes a block header, since
+ * the arena may be updating the prev_alloc bit of the same header at the same time under its lock.
+ * Consequently, the payload size in the header of a block that passed through a cache is not kept
+ * up to date (a refill records the whole block), a double free of a cached block is not detected,
+ * and sf_internal_fragmentation() and sf_peak_utilization() count cached blocks as fully used.
+ *
+ * In other builds, the functions below compile away and the allocator is single-threaded as before.
+ */
+
+#ifdef SF_THREADS
+
+void* tcache_malloc(uint32_t blk_size);
+int tcache_free(sf_block* blk);
+int tcache_free_sized(sf_block* blk, uint32_t blk_size);
+int tcache_flush();
+
+#else
+
+#define tcache_malloc(BLK_SIZE) NULL
+#define tcache_free(BLK) 0
+#define tcache_free_sized(BLK, BLK_SIZE) 0
+#define tcache_flush() 0
+
+#endif
+
+#endif
@@ -0,0 +1,20 @@
+#ifndef TIMING_H
+#define TIMING_H
+
+/*
+ * Monotonic clock readings shared by the allocator's statistics export and recorder, and by the
+ * benchmarks. clock_gettime needs _POSIX_C_SOURCE or _DEFAULT_SOURCE defined before the first
+ * include of this file.
+ */
+
+#include <stdint.h>
+#include <time.h>
+
+// Returns the time of the monotonic clock in ns.
+static inline uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t) ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+#endif
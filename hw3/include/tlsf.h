@@ -0,0 +1,23 @@
+#ifndef TLSF_H
+#define TLSF_H
+
+/*
+ * Two-level segregated fit (TLSF) free block index, used in place of first-fit search when the
+ * allocator is built with TLSF defined (make tlsf).
+ *
+ * The first level is the existing set of free lists in sf_free_list_heads. Each list is split into
+ * TLSF_SL_COUNT second-level ranges of equal width. The last list has no upper bound, so its
+ * ranges double in width instead. Blocks stay in the circular lists described in sfmm.h, but each
+ * list is kept ordered by range, and the first block of every non-empty range is recorded. Together
+ * with a bitmap per level, this gives constant-time insertion, removal and good-fit search.
+ */
+
+#define TLSF_SL_COUNT 8
+
+void tlsf_init();
+int tlsf_bucket(uint32_t size);
+void tlsf_insert_blk(sf_block* blk, uint32_t size);
+void tlsf_remove_blk(sf_block* blk, uint32_t size);
+sf_block* tlsf_find_fit(uint32_t blk_size);
+
+#endif
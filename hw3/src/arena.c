@@ -0,0 +1,213 @@
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include "sfmm.h"
+#include "helper.h"
+#include "arena.h"
+
+#ifdef SF_THREADS
+#include <errno.h>
+#include <sys/mman.h>
+
+// Start of the reservation holding arenas 1 and up, or NULL if it has not been made.
+static char* arena_base;
+
+static pthread_once_t arenas_once = PTHREAD_ONCE_INIT;
+static void arenas_init();
+#endif
+
+struct sf_arena arenas[SF_ARENAS] = {
+    [0] = {
+        .index = 0,
+        .quick_lists = sf_quick_lists,
+        .free_list_heads = sf_free_list_heads,
+#ifdef SF_THREADS
+        .lock = PTHREAD_MUTEX_INITIALIZER,
+#endif
+    }
+};
+
+ARENA_LOCAL struct sf_arena* cur_arena = &arenas[0];
+
+// Number of arenas threads are assigned to. Arenas past it are left unused.
+int arena_limit = SF_ARENAS;
+
+// Given an address, return the arena whose heap contains it, or NULL if there is none.
+struct sf_arena* arena_of(void* ptr) {
+#ifdef SF_THREADS
+    pthread_once(&arenas_once, arenas_init);
+#endif
+    if(ptr >= sf_mem_start() && ptr < sf_mem_end()) {return &arenas[0];}
+
+#ifdef SF_THREADS
+    if(arena_base && (char*) ptr >= arena_base && (char*) ptr < arena_base + (SF_ARENAS - 1) * (size_t) SF_ARENA_SIZE) {
+        struct sf_arena* arena = &arenas[1 + ((char*) ptr - arena_base) / SF_ARENA_SIZE];
+        if(ptr < __atomic_load_n(&arena->end, __ATOMIC_RELAXED)) {return arena;}
+    }
+#endif
+
+    return NULL;
+}
+
+#ifdef SF_THREADS
+static pthread_key_t arena_key;
+static int next_arena;
+
+// The calling thread's arena, or NULL if it has not been assigned one.
+static __thread struct sf_arena* thread_arena;
+
+// Key destructor, run when a thread exits. Unassign the thread from its arena.
+static void arena_release(void* arg) {
+    struct sf_arena* arena = (struct sf_arena*) arg;
+    __atomic_fetch_sub(&arena->threads, 1, __ATOMIC_RELAXED);
+}
+
+// Set up arenas 1 and up, and reserve their memory. If the reservation fails, only arena 0 is used.
+// sfutil sets up arena 0's memory and the magic number on its first call, so that call is made here first, by
+// init_hdr_magic: two threads making it at once would each replace both. arena_of runs without a lock, so it waits for this too.
+static void arenas_init() {
+    init_hdr_magic();
+    pthread_key_create(&arena_key, arena_release);
+    if(SF_ARENAS == 1) {return;}
+
+    size_t size = (SF_ARENAS - 1) * (size_t) SF_ARENA_SIZE;
+    char* base = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if(base == MAP_FAILED) {
+        arena_limit = 1;
+        return;
+    }
+
+    for(int i = 1; i < SF_ARENAS; i++) {
+        struct sf_arena* arena = &arenas[i];
+        arena->index = i;
+        arena->quick_lists = arena->own_quick_lists;
+        arena->free_list_heads = arena->own_free_list_heads;
+        pthread_mutex_init(&arena->lock, NULL);
+        arena->start = arena->end = base + (i - 1) * (size_t) SF_ARENA_SIZE;
+        arena->limit = (char*) arena->start + SF_ARENA_SIZE;
+    }
+    arena_base = base;
+}
+
+// Move the calling thread to the given arena.
+static void arena_assign(struct sf_arena* arena) {
+    if(thread_arena) {__atomic_fetch_sub(&thread_arena->threads, 1, __ATOMIC_RELAXED);}
+    __atomic_fetch_add(&arena->threads, 1, __ATOMIC_RELAXED);
+    thread_arena = arena;
+    pthread_setspecific(arena_key, arena);
+}
+
+// Free every block on the arena's remote free stack. The arena must be locked.
+static void arena_drain_remote_frees(struct sf_arena* arena) {
+    if(!__atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED)) {return;}
+
+    struct sf_block* blk = __atomic_exchange_n(&arena->remote_frees, NULL, __ATOMIC_ACQUIRE);
+    while(blk) {
+        struct sf_block* next = blk->body.links.next;
+        heap_free(blk);
+        arena->remote_free_count++;
+        blk = next;
+    }
+}
+
+// Returns nonzero if the given arena is not the calling thread's arena.
+int arena_is_remote(struct sf_arena* arena) {
+    return arena != thread_arena;
+}
+
+// Push a valid allocated block onto its arena's remote free stack, without taking the arena's lock.
+void arena_remote_free(struct sf_arena* arena, sf_block* blk) {
+    struct sf_block* head = __atomic_load_n(&arena->remote_frees, __ATOMIC_RELAXED);
+    do {
+        blk->body.links.next = head;
+    } while(!__atomic_compare_exchange_n(&arena->remote_frees, &head, blk, 1, __ATOMIC_RELEASE, __ATOMIC_RELAXED));
+}
+
+// Lock the given arena and make it the current arena.
+void arena_lock(struct sf_arena* arena) {
+    pthread_once(&arenas_once, arenas_init);
+
+    if(pthread_mutex_trylock(&arena->lock) != 0) {
+        __atomic_fetch_add(&arena->lock_contentions, 1, __ATOMIC_RELAXED);
+        pthread_mutex_lock(&arena->lock);
+    }
+    arena->lock_acquisitions++;
+    cur_arena = arena;
+    arena_drain_remote_frees(arena);
+}
+
+void arena_unlock(struct sf_arena* arena) {
+    pthread_mutex_unlock(&arena->lock);
+}
+
+// Lock every arena, in index order, so that settings shared by all arenas can be changed.
+void arena_lock_all() {
+    for(int i = 0; i < SF_ARENAS; i++) {
+        arena_lock(&arenas[i]);
+    }
+}
+
+void arena_unlock_all() {
+    for(int i = SF_ARENAS - 1; i >= 0; i--) {
+        arena_unlock(&arenas[i]);
+    }
+}
+
+// Lock and return the calling thread's arena, assigning one round-robin if it has none.
+// If the thread's arena is locked by another thread, the first other arena that is free is taken instead, and kept.
+struct sf_arena* arena_get() {
+    pthread_once(&arenas_once, arenas_init);
+
+    int limit = __atomic_load_n(&arena_limit, __ATOMIC_RELAXED);
+    if(!thread_arena || thread_arena->index >= limit) {
+        arena_assign(&arenas[__atomic_fetch_add(&next_arena, 1, __ATOMIC_RELAXED) % limit]);
+    }
+
+    struct sf_arena* arena = thread_arena;
+    if(pthread_mutex_trylock(&arena->lock) != 0) {
+        __atomic_fetch_add(&arena->lock_contentions, 1, __ATOMIC_RELAXED);
+
+        for(int i = 1; i < limit; i++) {
+            struct sf_arena* other = &arenas[(arena->index + i) % limit];
+            if(pthread_mutex_trylock(&other->lock) == 0) {
+                arena_assign(other);
+                other->lock_acquisitions++;
+                cur_arena = other;
+                arena_drain_remote_frees(other);
+                return other;
+            }
+        }
+
+        pthread_mutex_lock(&arena->lock);
+    }
+    arena->lock_acquisitions++;
+    cur_arena = arena;
+    arena_drain_remote_frees(arena);
+    return arena;
+}
+
+void* arena_mem_start(struct sf_arena* arena) {
+    return arena->index ? arena->start : sf_mem_start();
+}
+
+void* arena_mem_end(struct sf_arena* arena) {
+    return arena->index ? arena->end : sf_mem_end();
+}
+
+// Extend the given arena's heap by one page, and return the start of the new page, or NULL if the arena is full.
+void* arena_mem_grow(struct sf_arena* arena) {
+    if(!arena->index) {return sf_mem_grow();}
+
+    char* page = (char*) arena->end;
+    if(page + PAGE_SZ > (char*) arena->limit) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    __atomic_store_n(&arena->end, page + PAGE_SZ, __ATOMIC_RELAXED);
+    return page;
+}
+
+// Returns nonzero if pages the given arena's heap grows by read as zero.
+int arena_mem_zeroed(struct sf_arena* arena) {
+    return arena->index != 0;
+}
+#endif
@@ -1,11 +1,91 @@
 #include <stdio.h>
+#include <string.h>
 #include <errno.h>
+#include <math.h>
+#include "debug.h"
 #include "sfmm.h"
+#include "sfmm_ext.h"
 #include "helper.h"
+#include "tlsf.h"
+#include "arena.h"
+
+// Compile-time defaults for the placement policy.
+#ifndef SF_POLICY_FIT
+#define SF_POLICY_FIT SF_FIRST_FIT
+#endif
+#ifndef SF_POLICY_BEST_FIT_CANDIDATES
+#define SF_POLICY_BEST_FIT_CANDIDATES 8
+#endif
+#ifndef SF_POLICY_ADDRESS_ORDERED
+#define SF_POLICY_ADDRESS_ORDERED 0
+#endif
+#ifndef SF_POLICY_SPLIT_HIGH_MIN
+#define SF_POLICY_SPLIT_HIGH_MIN 0
+#endif
+
+struct sf_placement_policy placement_policy = {
+    SF_POLICY_FIT, SF_POLICY_BEST_FIT_CANDIDATES, SF_POLICY_ADDRESS_ORDERED, SF_POLICY_SPLIT_HIGH_MIN
+};
+
+// Compile-time default for the heap growth factor. A factor of 1 grows the heap by exactly what each request needs.
+#ifndef SF_GROWTH_FACTOR
+#define SF_GROWTH_FACTOR 1.0
+#endif
+
+double growth_factor = SF_GROWTH_FACTOR;
+
+// Compile-time default for the number of pending frees that triggers a coalescing sweep. 0 coalesces on every free.
+#ifndef SF_COALESCE_THRESHOLD
+#define SF_COALESCE_THRESHOLD 0
+#endif
+
+int coalesce_threshold = SF_COALESCE_THRESHOLD;
+
+// Compile-time defaults for the quick list configuration. The defaults give the fixed lists described in sfmm.h.
+#ifndef SF_QUICK_LISTS
+#define SF_QUICK_LISTS NUM_QUICK_LISTS
+#endif
+#ifndef SF_QUICK_LIST_ADAPTIVE
+#define SF_QUICK_LIST_ADAPTIVE 0
+#endif
+#ifndef SF_QUICK_LIST_MIN
+#define SF_QUICK_LIST_MIN 1
+#endif
+#ifndef SF_QUICK_LIST_CAPACITY_MAX
+#define SF_QUICK_LIST_CAPACITY_MAX 32
+#endif
+#ifndef SF_QUICK_LIST_FLUSH_PERCENT
+#define SF_QUICK_LIST_FLUSH_PERCENT 100
+#endif
+
+// Number of quick list lookups and insertions in an arena between adaptations of the list capacities.
+#ifndef SF_QUICK_LIST_PERIOD
+#define SF_QUICK_LIST_PERIOD 256
+#endif
+
+struct sf_quick_list_config quick_list_config = {
+    SF_QUICK_LISTS, SF_QUICK_LIST_ADAPTIVE, SF_QUICK_LIST_MIN, SF_QUICK_LIST_CAPACITY_MAX, SF_QUICK_LIST_FLUSH_PERCENT
+};
+
+#ifndef SF_FAST
+sf_header hdr_magic;
+#endif
+
+// Caches the key headers are stored with. sfutil sets up the magic number on its first call, so that call is made here
+// first. The fast build stores headers in the clear, so it sets the magic number to 0 instead, which keeps sfutil's
+// heap printers and everything else that decodes headers with MAGIC in agreement.
+void init_hdr_magic() {
+    sf_mem_start();
+#ifdef SF_FAST
+    sf_set_magic(0x0);
+#else
+    hdr_magic = MAGIC;
+#endif
+}
 
-// sf_mem_grow wrapper with error handling.
+// arena_mem_grow wrapper with error handling.
 void* safe_sf_mem_grow() {
-    void* new_page = sf_mem_grow();
+    void* new_page = arena_mem_grow(cur_arena);
     if(!new_page) {
         sf_errno = ENOMEM;
         return NULL;
@@ -15,60 +95,107 @@ void* safe_sf_mem_grow() {
 
 // Initialize the heap.
 int init_heap() {
+#ifndef SF_THREADS
+    // A threaded build does this once for all arenas, in arenas_init.
+    init_hdr_magic();
+#endif
+
     void* new_page = safe_sf_mem_grow();
     if(!new_page) {return -1;}
 
     // Create prologue: size 32, only alloc bit set.
-    struct sf_block* prologue_blk = (sf_block*) sf_mem_start();
-    prologue_blk->header = (32 | 4) ^ MAGIC;
+    struct sf_block* prologue_blk = (sf_block*) arena_mem_start(cur_arena);
+    set_blk_header(prologue_blk, 32, 0, 4);
 
     // Create epilogue: size 0, only alloc bit set.
-    struct sf_block* epilogue_blk = (sf_block*) (sf_mem_end() - 16);
-    epilogue_blk->header = 4 ^ MAGIC;
+    struct sf_block* epilogue_blk = (sf_block*) (arena_mem_end(cur_arena) - 16);
+    set_blk_header(epilogue_blk, 0, 0, 4);
 
     // Create quick lists and free lists.
     init_quick_lists();
     init_free_lists();
 
     // Store the remaining memory (976 bytes) into a block.
-    struct sf_block* rem_blk = (sf_block*) (sf_mem_start() + 32);
-    clear_blk_sizes(rem_blk);
-    clear_info_bits(rem_blk);
-    add_blk_sizes(rem_blk, (uint64_t) 976, 0);
-    add_info_bits(rem_blk, 2);
+    struct sf_block* rem_blk = (sf_block*) (arena_mem_start(cur_arena) + 32);
+    set_blk_header(rem_blk, 976, 0, 2);
     epilogue_blk->prev_footer = rem_blk->header;
 
     // Place into free list.
     add_free_list_blk(rem_blk, 976);
 
+    // A zeroed page is clean after the header and links of the block.
+    cur_arena->clean = arena_mem_zeroed(cur_arena) ? ((void*) rem_blk) + 32 : (void*) UINTPTR_MAX;
+
     return 0;
 }
 
-// Extends the heap by 1024 bytes.
-int add_mem_page() {
-    void* new_page = safe_sf_mem_grow();
-    if(!new_page) {return -1;}
+// Extends the heap so that the block before the epilogue is free and can hold blk_size bytes, and returns that block.
+// All pages the request needs are acquired in one step, then turned into a single free block and coalesced once.
+// After the first grow event, each grow acquires at least growth_factor times as many pages as the previous one.
+// If the heap cannot be extended far enough, whatever was acquired is kept as free space, and NULL is returned.
+sf_block* grow_heap(uint32_t blk_size) {
+    // A free block before the epilogue (the wilderness) is extended instead of left behind.
+    struct sf_block* epilogue_blk = (sf_block*) (arena_mem_end(cur_arena) - 16);
+    uint64_t wild_size = (get_info_bits(epilogue_blk) & 2) ? 0 : get_prev_blk_size(epilogue_blk);
+    if(wild_size >= blk_size) {return (sf_block*) (((void*) epilogue_blk) - wild_size);}
+
+    uint32_t pages = (blk_size - wild_size + PAGE_SZ - 1) / PAGE_SZ;
+    if(cur_arena->last_grow_pages) {
+        uint32_t geometric_pages = (uint32_t) ceil(cur_arena->last_grow_pages * growth_factor);
+        if(geometric_pages > pages) {pages = geometric_pages;}
+    }
+
+    // Geometric growth may ask for more pages than the request needs, so running out partway is only an error if the
+    // pages acquired do not cover the request.
+    int saved_errno = sf_errno;
+    void* new_page = NULL;
+    uint32_t grown = 0;
+    while(grown < pages) {
+        void* page = safe_sf_mem_grow();
+        if(!page) {break;}
+        if(!new_page) {new_page = page;}
+        grown++;
+    }
+    sf_errno = saved_errno;
+    if(!grown) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    cur_arena->last_grow_pages = grown;
 
     // Build new block on top of old epilogue area.
+    uint64_t new_size = (uint64_t) grown * PAGE_SZ;
     struct sf_block* new_mem = (sf_block*) (new_page - 16);
-    clear_blk_sizes(new_mem);
-    new_mem->header = ((new_mem->header ^ MAGIC) & 2) ^ MAGIC;
-    add_blk_sizes(new_mem, (uint64_t) 1024, 0);
+    set_blk_header(new_mem, new_size, 0, get_info_bits(new_mem) & 2);
 
     // Create new epilogue.
-    struct sf_block* epilogue_blk = (sf_block*) (sf_mem_end() - 16);
-    clear_blk_sizes(epilogue_blk);
-    clear_info_bits(epilogue_blk);
-    add_info_bits(epilogue_blk, 4);
+    epilogue_blk = (sf_block*) (arena_mem_end(cur_arena) - 16);
+    set_blk_header(epilogue_blk, 0, 0, 4);
     epilogue_blk->prev_footer = new_mem->header;
 
     // Put new block into free lists.
-    add_free_list_blk(new_mem, 1024);
+    add_free_list_blk(new_mem, new_size);
+
+    trace(TRACE_GROW, new_page, new_size);
+    cur_arena->grows++;
 
     // Perform coalescing.
-    coalesce_prev_blk(new_mem);
+    struct sf_block* wilderness = coalesce_prev_blk(new_mem);
+    if(!wilderness) {wilderness = new_mem;}
+
+    // Zeroed pages extend a clean wilderness once the old footer and epilogue are cleared. Otherwise they are clean
+    // after the header and links of the new block.
+    if(arena_mem_zeroed(cur_arena)) {
+        if(cur_arena->clean <= ((void*) new_mem)) {memset(new_mem, 0, 32);}
+        else {cur_arena->clean = ((void*) new_mem) + 32;}
+    }
 
-    return 0;
+    // The heap reached its limit before the request could be covered.
+    if(get_blk_size(wilderness) < blk_size) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    return wilderness;
 }
 
 // Given the size of the requested memory, return the size of the entire block.
@@ -79,108 +206,130 @@ uint32_t get_req_blk_size(sf_size_t size) {
     return blk_size;
 }
 
-// Returns the info bits of the previous block.
-uint64_t get_prev_blk_size(sf_block* blk) {
-    return (blk->prev_footer ^ MAGIC) & 0x00000000FFFFFFF0;
-}
-
-// Returns the size of a valid block.
-uint64_t get_blk_size(sf_block* blk) {
-    return (blk->header ^ MAGIC) & 0x00000000FFFFFFF0;
-}
-
-// Returns the payload size of a valid block.
-uint64_t get_payload_size(sf_block* blk) {
-    return ((blk->header ^ MAGIC) & 0xFFFFFFFF00000000) >> 32;
-}
-
-// Sets size bits of header field of a valid block.
-void add_blk_sizes(sf_block* blk, uint64_t blk_size, uint64_t payload_size) {
-    uint64_t sizes = (((uint64_t)(payload_size) << 32) | blk_size);
-    blk->header = ((blk->header ^ MAGIC) | sizes) ^ MAGIC;
-}
-
-// Clears size bits of header field of a valid block.
-void clear_blk_sizes(sf_block* blk) {
-    blk->header = ((blk->header ^ MAGIC) & 0x000000000000000F) ^ MAGIC;
-}
+// Given the size of a block, return the index of the quicklist it would be in.
+int get_quick_list_idx(uint32_t size) {
+    int index;
+    if(size < 32) {return -1;}
+    else if(size == 32) {index = 0;}
+    else if(size == 48) {index = 1;}
+    else if(size == 64) {index = 2;}
+    else if(size == 80) {index = 3;}
+    else if(size == 96) {index = 4;}
+    else if(size == 112) {index = 5;}
+    else if(size == 128) {index = 6;}
+    else if(size == 144) {index = 7;}
+    else if(size == 160) {index = 8;}
+    else if(size == 176) {index = 9;}
+    else {return -1;}
 
-// Clears payload bits only of header field of a valid block.
-void clear_payload_size(sf_block* blk) {
-    blk->header = ((blk->header ^ MAGIC) & 0x00000000FFFFFFFF) ^ MAGIC;
+    // Only the configured number of lists, from the smallest size up, are in use.
+    return (index < quick_list_config.lists) ? index : -1;
 }
 
-// Returns the info bits of the previous block.
-uint64_t get_prev_info_bits(sf_block* blk) {
-    return (blk->prev_footer ^ MAGIC) & 0x000000000000000F;
+// Returns the capacity a quick list starts with: QUICK_LIST_MAX, kept within the adaptive bounds if capacities adapt.
+static int initial_quick_list_capacity() {
+    int capacity = QUICK_LIST_MAX;
+    if(quick_list_config.adaptive) {
+        if(capacity > quick_list_config.max_capacity) {capacity = quick_list_config.max_capacity;}
+        if(capacity < quick_list_config.min_capacity) {capacity = quick_list_config.min_capacity;}
+    }
+    return capacity;
 }
 
-// Returns the info bits of a valid block.
-uint64_t get_info_bits(sf_block* blk) {
-    return (blk->header ^ MAGIC) & 0x000000000000000F;
+// Initialize quick lists.
+void init_quick_lists() {
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        cur_arena->quick_lists[i].first = NULL;
+        cur_arena->quick_lists[i].length = 0;
+        cur_arena->quick_list_capacity[i] = initial_quick_list_capacity();
+        cur_arena->quick_list_hits[i] = 0;
+        cur_arena->quick_list_misses[i] = 0;
+        cur_arena->quick_list_flushes[i] = 0;
+    }
+    cur_arena->quick_list_ops = 0;
 }
 
-// Sets info bits of header field of a valid block (3 lsb's).
-void add_info_bits(sf_block* blk, int info) {
-    blk->header = ((blk->header ^ MAGIC) | info) ^ MAGIC;
-}
+// Applies the quick list configuration to the current arena: lists out of range are emptied and the others trimmed to their capacity.
+void apply_quick_list_config() {
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        if(!quick_list_config.adaptive) {cur_arena->quick_list_capacity[i] = QUICK_LIST_MAX;}
+        else if(cur_arena->quick_list_capacity[i] > quick_list_config.max_capacity) {cur_arena->quick_list_capacity[i] = quick_list_config.max_capacity;}
+        else if(cur_arena->quick_list_capacity[i] < quick_list_config.min_capacity) {cur_arena->quick_list_capacity[i] = quick_list_config.min_capacity;}
 
-// Clears info bits of header field of a valid block (3 lsb's).
-void clear_info_bits(sf_block* blk) {
-    blk->header = ((blk->header ^ MAGIC) & 0xFFFFFFFFFFFFFFF0) ^ MAGIC;
+        int keep = (i < quick_list_config.lists) ? cur_arena->quick_list_capacity[i] : 0;
+        int length = cur_arena->quick_lists[i].length;
+        if(length > keep) {flush_quicklist(i, length - keep);}
+    }
 }
 
-// Given the size of a block, return the index of the quicklist it would be in.
-int get_quick_list_idx(uint32_t size) {
-    if(size < 32) {return -1;}
-    else if(size == 32) {return 0;}
-    else if(size == 48) {return 1;}
-    else if(size == 64) {return 2;}
-    else if(size == 80) {return 3;}
-    else if(size == 96) {return 4;}
-    else if(size == 112) {return 5;}
-    else if(size == 128) {return 6;}
-    else if(size == 144) {return 7;}
-    else if(size == 160) {return 8;}
-    else if(size == 176) {return 9;}
-    else {return -1;}
-}
+// Counts a quick list lookup or insertion, and adapts the list capacities at the end of each period.
+// A list that overflowed and later came up empty grows, since the blocks it flushed could have been reused.
+// A list that served no request shrinks and releases its excess blocks to the free lists.
+static void count_quick_list_op() {
+    if(!quick_list_config.adaptive || ++cur_arena->quick_list_ops < SF_QUICK_LIST_PERIOD) {return;}
+    cur_arena->quick_list_ops = 0;
+
+    for(int i = 0; i < quick_list_config.lists; i++) {
+        int capacity = cur_arena->quick_list_capacity[i];
+        if(cur_arena->quick_list_flushes[i] && cur_arena->quick_list_misses[i]) {
+            capacity *= 2;
+            if(capacity > quick_list_config.max_capacity) {capacity = quick_list_config.max_capacity;}
+        }
+        else if(!cur_arena->quick_list_hits[i]) {
+            capacity /= 2;
+            if(capacity < quick_list_config.min_capacity) {capacity = quick_list_config.min_capacity;}
+            if(cur_arena->quick_lists[i].length > capacity) {flush_quicklist(i, cur_arena->quick_lists[i].length - capacity);}
+        }
+        cur_arena->quick_list_capacity[i] = capacity;
 
-// Initialize quick lists.
-void init_quick_lists() {
-    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
-        sf_quick_lists[i].first = NULL;
-        sf_quick_lists[i].length = 0;
+        cur_arena->quick_list_hits[i] = 0;
+        cur_arena->quick_list_misses[i] = 0;
+        cur_arena->quick_list_flushes[i] = 0;
     }
 }
 
 // Adds a block to a quick list.
 void add_quick_list_blk(sf_block* blk, uint32_t size) {
-    struct sf_block* head = sf_quick_lists[get_quick_list_idx(size)].first;
-    int length = sf_quick_lists[get_quick_list_idx(size)].length;
-
-    // If quick list is at capacity, flush.
-    if(length == QUICK_LIST_MAX) {
-        flush_quicklist(get_quick_list_idx(size));
-        sf_quick_lists[get_quick_list_idx(size)].first = blk;
-        sf_quick_lists[get_quick_list_idx(size)].length++;
-        return;
+    int index = get_quick_list_idx(size);
+
+    // If quick list is at capacity, flush part of it, oldest blocks first.
+    int length = cur_arena->quick_lists[index].length;
+    if(length >= cur_arena->quick_list_capacity[index]) {
+        int count = length * quick_list_config.flush_percent / 100;
+        flush_quicklist(index, (count < 1) ? 1 : count);
+        cur_arena->quick_list_flushes[index]++;
+        cur_arena->quick_list_flush_count[index]++;
     }
 
     // Adds block at front of the quick list.
-    sf_quick_lists[get_quick_list_idx(size)].first = blk;
-    blk->body.links.next = head;
+    blk->body.links.next = cur_arena->quick_lists[index].first;
+    cur_arena->quick_lists[index].first = blk;
 
     // Increment length.
-    sf_quick_lists[get_quick_list_idx(size)].length++;
+    cur_arena->quick_lists[index].length++;
+
+    count_quick_list_op();
 }
 
-// Removes all items from a quicklist and adds it to free lists.
-void flush_quicklist(int index) {
-    for(int i = 0; i < QUICK_LIST_MAX; i++) {
+// Removes the given number of blocks from a quicklist, oldest first, and adds them to free lists.
+void flush_quicklist(int index, int count) {
+    trace(TRACE_FLUSH, index, count);
+
+    // The oldest blocks are at the end of the list, so detach it after the blocks that are kept.
+    int keep = cur_arena->quick_lists[index].length - count;
+    struct sf_block** link = &cur_arena->quick_lists[index].first;
+    for(int i = 0; i < keep; i++) {
+        link = &(*link)->body.links.next;
+    }
+    struct sf_block* curr_blk = *link;
+    *link = NULL;
+    cur_arena->quick_lists[index].length = keep;
+
+    for(int i = 0; i < count; i++) {
+        struct sf_block* next_flush_blk = curr_blk->body.links.next;
+
         // Set alloc bit to 0, set quick list bit to 0.
-        struct sf_block* curr_blk = sf_quick_lists[index].first;
-        curr_blk->header = (((curr_blk->header) ^ MAGIC) & 0xFFFFFFFFFFFFFFF2) ^ MAGIC;
+        keep_info_bits(curr_blk, 2);
 
         // Add footer.
         void* next_blk_start = ((void*) curr_blk) + get_blk_size(curr_blk);
@@ -188,7 +337,7 @@ void flush_quicklist(int index) {
         next_blk->prev_footer = curr_blk->header;
 
         // Set next block's prev_alloc bit to 0.
-        next_blk->header = (((next_blk->header) ^ MAGIC) & 0xFFFFFFFFFFFFFFF5) ^ MAGIC;
+        keep_info_bits(next_blk, 5);
 
         // Set next block's footer to match if it is free.
         if(get_info_bits(next_blk) < 4) {
@@ -198,24 +347,28 @@ void flush_quicklist(int index) {
         }
 
         // Insert into free list.
-        sf_quick_lists[index].first = curr_blk->body.links.next;
         add_free_list_blk(curr_blk, get_blk_size(curr_blk));
 
-        // Coalesce with adjacent blocks if applicable.
-        struct sf_block* merge_prev = coalesce_prev_blk(curr_blk);
-        if(merge_prev) {
-            coalesce_next_blk(merge_prev);
+        // With deferred coalescing, the block is merged by the next sweep of the heap.
+        if(coalesce_threshold) {
+            cur_arena->pending_frees++;
         }
         else {
-            coalesce_next_blk(curr_blk);
+            // Coalesce with adjacent blocks if applicable.
+            struct sf_block* merge_prev = coalesce_prev_blk(curr_blk);
+            if(merge_prev) {
+                coalesce_next_blk(merge_prev);
+            }
+            else {
+                coalesce_next_blk(curr_blk);
+            }
         }
 
-        sf_show_heap();
+        curr_blk = next_flush_blk;
     }
 
-    // Reset list.
-    sf_quick_lists[index].first = NULL;
-    sf_quick_lists[index].length = 0;
+    // The blocks still in the list are marked allocated, so a sweep leaves them alone.
+    if(coalesce_threshold && cur_arena->pending_frees >= coalesce_threshold) {coalesce_heap();}
 }
 
 // Given the size of a block, search quick lists for a block of that exact size. If none found, return NULL.
@@ -223,21 +376,30 @@ void* search_quicklists(uint32_t blk_size, uint32_t payload_size) {
     int index = get_quick_list_idx(blk_size);
     if(index == -1) {return NULL;}
 
-    struct sf_block* head = sf_quick_lists[index].first;
+    // Count the lookup before taking a block, since adapting the capacities may flush this list.
+    if(cur_arena->quick_lists[index].first) {
+        cur_arena->quick_list_hits[index]++;
+        cur_arena->quick_list_hit_count[index]++;
+    }
+    else {
+        cur_arena->quick_list_misses[index]++;
+        cur_arena->quick_list_miss_count[index]++;
+    }
+    count_quick_list_op();
+
+    struct sf_block* head = cur_arena->quick_lists[index].first;
 
     // If block that exactly satisfies request is fulfilled, then remove from quick list and return payload address.
     if(head) {
         // Redirect pointers to remove.
         struct sf_block* next_blk = head->body.links.next;
-        sf_quick_lists[index].first = next_blk;
+        cur_arena->quick_lists[index].first = next_blk;
 
         //Adjust header of the removed block: keep 1 in alloc bit, keep prev_alloc bit, and 0 in quick_list bit. Add block size.
-        clear_blk_sizes(head);
-        add_blk_sizes(head, (uint64_t) blk_size, (uint64_t) payload_size);
-        head->header = ((head->header ^ MAGIC) & ~1) ^ MAGIC;
+        set_blk_header(head, blk_size, payload_size, get_info_bits(head) & ~1);
 
         // Decrement list length.
-        sf_quick_lists[index].length--;
+        cur_arena->quick_lists[index].length--;
 
         return &(head->body.payload);
     }
@@ -261,39 +423,81 @@ int get_free_list_idx(uint32_t size) {
     else {return 9;}
 }
 
+// Given the size of a block, return the index of the first free list whose blocks are all at least that large.
+// Returns NUM_FREE_LISTS if no such list exists.
+int get_free_list_fit_idx(uint32_t size) {
+    int index = get_free_list_idx(size);
+
+    // The smallest block in list i (i > 0) is one alignment step above the upper bound of list i - 1.
+    uint32_t list_min = (index == 0) ? 32 : (((uint32_t) 32 << (index - 1)) + 16);
+    return (size <= list_min) ? index : index + 1;
+}
+
 // Initialize free lists.
 void init_free_lists() {
     for(int i = 0; i < NUM_FREE_LISTS; i++) {
-        sf_free_list_heads[i].body.links.prev = sf_free_list_heads[i].body.links.next =  &sf_free_list_heads[i];
+        cur_arena->free_list_heads[i].body.links.prev = cur_arena->free_list_heads[i].body.links.next =  &cur_arena->free_list_heads[i];
     }
+    cur_arena->free_list_bitmap = 0;
+
+#ifdef TLSF
+    tlsf_init();
+#endif
 }
 
 // Adds a block to a free list.
 void add_free_list_blk(sf_block* blk, uint32_t size) {
-    struct sf_block* sentinel = &sf_free_list_heads[get_free_list_idx(size)];
+#ifdef TLSF
+    tlsf_insert_blk(blk, size);
+    return;
+#endif
+
+    int index = get_free_list_idx(size);
+    struct sf_block* sentinel = &cur_arena->free_list_heads[index];
     struct sf_block* next = sentinel->body.links.next;
-    sentinel->body.links.next = next->body.links.prev = blk;
-    blk->body.links.prev = sentinel;
+
+    // Under address ordering, insert in front of the first block at a higher address instead of at the head.
+    if(placement_policy.address_ordered) {
+        while(next != sentinel && next < blk) {
+            next = next->body.links.next;
+        }
+    }
+
+    struct sf_block* prev = next->body.links.prev;
+    prev->body.links.next = next->body.links.prev = blk;
+    blk->body.links.prev = prev;
     blk->body.links.next = next;
+    cur_arena->free_list_bitmap |= (1u << index);
 }
 
-// Deletes a block from a free list.
+// Deletes a block from a free list. The block's own links are used to unlink it, so no list traversal is needed.
 void delete_free_list_blk(sf_block* blk, uint32_t size) {
-    struct sf_block* current_blk = &sf_free_list_heads[get_free_list_idx(size)];
-    while(current_blk != blk) {
-        current_blk= current_blk->body.links.next;
-    }
-    struct sf_block* prev_blk = current_blk->body.links.prev;
-    struct sf_block* next_blk = current_blk->body.links.next;
+#ifdef TLSF
+    tlsf_remove_blk(blk, size);
+    return;
+#endif
+
+    struct sf_block* prev_blk = blk->body.links.prev;
+    struct sf_block* next_blk = blk->body.links.next;
     prev_blk->body.links.next = next_blk;
     next_blk->body.links.prev = prev_blk;
-    current_blk->body.links.prev = current_blk->body.links.next = NULL;
+    blk->body.links.prev = blk->body.links.next = NULL;
+
+    // Clear the list's bit if the block was the last one in it.
+    int index = get_free_list_idx(size);
+    if(cur_arena->free_list_heads[index].body.links.next == &cur_arena->free_list_heads[index]) {
+        cur_arena->free_list_bitmap &= ~(1u << index);
+    }
 }
 
 // Relocates block after change in size, if necessary.
 void relocate_free_list_blk(sf_block* blk, uint32_t old_size, uint32_t new_size) {
-    // If block needs to be relocated.
+    // If block needs to be relocated. TLSF also orders blocks by range within a list, so it may move within a list.
+#ifdef TLSF
+    if(tlsf_bucket(old_size) != tlsf_bucket(new_size)) {
+#else
     if(get_free_list_idx(old_size) != get_free_list_idx(new_size)) {
+#endif
         // Delete from old list.
         delete_free_list_blk(blk, old_size);
 
@@ -302,88 +506,265 @@ void relocate_free_list_blk(sf_block* blk, uint32_t old_size, uint32_t new_size)
     }
 }
 
+// Given the index of a guaranteed-fit class, return the first block of the lowest non-empty class at or above it.
+static sf_block* first_guaranteed_fit(int fit_idx) {
+    if(fit_idx >= NUM_FREE_LISTS) {return NULL;}
+    uint32_t candidates = cur_arena->free_list_bitmap & ~((1u << fit_idx) - 1);
+    if(!candidates) {return NULL;}
+    return cur_arena->free_list_heads[__builtin_ctz(candidates)].body.links.next;
+}
+
+// Given the size of a block, return the smallest of the first best_fit_candidates blocks that can hold it.
+static sf_block* find_best_fit(uint32_t blk_size) {
+    struct sf_block* best = NULL;
+    uint64_t best_size = 0;
+    int seen = 0;
+
+    uint32_t lists = cur_arena->free_list_bitmap & ~((1u << get_free_list_idx(blk_size)) - 1);
+    while(lists) {
+        int index = __builtin_ctz(lists);
+        lists &= lists - 1;
+
+        // Every block in a higher class is larger than one already found.
+        if(best && index > get_free_list_idx(best_size)) {break;}
+
+        struct sf_block* sentinel = &cur_arena->free_list_heads[index];
+        struct sf_block* curr_blk = sentinel->body.links.next;
+        while(curr_blk != sentinel) {
+            uint64_t curr_size = get_blk_size(curr_blk);
+            if(curr_size >= blk_size) {
+                if(!best || curr_size < best_size) {
+                    best = curr_blk;
+                    best_size = curr_size;
+                }
+                if(curr_size == blk_size || ++seen >= placement_policy.best_fit_candidates) {return best;}
+            }
+            curr_blk = curr_blk->body.links.next;
+        }
+    }
+    return best;
+}
+
+// Given the size of a block, return a free list block that can hold it according to the placement policy, or NULL.
+// Only the class the size falls in can hold blocks that are too small. Every block in a higher class fits, so those
+// classes are not scanned: the non-empty bitmap gives the first usable class directly.
+sf_block* find_free_list_fit(uint32_t blk_size) {
+#ifdef TLSF
+    return tlsf_find_fit(blk_size);
+#endif
+
+    if(placement_policy.fit == SF_BEST_FIT) {return find_best_fit(blk_size);}
+
+    int start_idx = get_free_list_idx(blk_size);
+    int fit_idx = get_free_list_fit_idx(blk_size);
+
+    // Good-fit only falls back to the starting class when no block is guaranteed to fit.
+    if(placement_policy.fit == SF_GOOD_FIT) {
+        struct sf_block* good_blk = first_guaranteed_fit(fit_idx);
+        if(good_blk) {return good_blk;}
+    }
+
+    // Scan the starting class first-fit, unless it is already the guaranteed-fit class.
+    if(start_idx != fit_idx && (cur_arena->free_list_bitmap & (1u << start_idx))) {
+        struct sf_block* sentinel = &cur_arena->free_list_heads[start_idx];
+        struct sf_block* curr_blk = sentinel->body.links.next;
+        while(curr_blk != sentinel) {
+            if(get_blk_size(curr_blk) >= blk_size) {return curr_blk;}
+            curr_blk = curr_blk->body.links.next;
+        }
+    }
+
+    if(placement_policy.fit == SF_GOOD_FIT) {return NULL;}
+
+    // Take the first block of the lowest non-empty class at or above the guaranteed-fit class.
+    return first_guaranteed_fit(fit_idx);
+}
+
 // Given the size of a block, search free lists for the smallest block that satisfies the request.
-// If there is no block large enough to satisfy the request, then extend heap. If heap space is exhausted, return NULL.
+// If there is no block large enough to satisfy the request, then extend heap and use the new wilderness block.
+// If heap space is exhausted, return NULL.
 void* search_freelists(uint32_t blk_size, uint32_t payload_size) {
-    while(1) {
-        int start_idx = get_free_list_idx(blk_size);
-        for(int i = start_idx; i < NUM_FREE_LISTS; i++) {
-            // Iterate over blocks of current head.
-            struct sf_block* sentinel = &sf_free_list_heads[i];
-            struct sf_block* curr_blk = sentinel->body.links.next;
-            while(curr_blk != sentinel) {
-                // If satisfactory block is found but it can be split without a splinter.
-                if(get_blk_size(curr_blk) >= (blk_size + 32)) {
-                    split_free_block(curr_blk, blk_size, payload_size);
-                    return &(curr_blk->body.payload);
-                }
-                // If satisfactory block is found of exact same size, or it cannot be split without a splinter.
-                else if(get_blk_size(curr_blk) >= blk_size) {
-                    delete_free_list_blk(curr_blk, get_blk_size(curr_blk));
-
-                    // Adjust header of the removed block: set alloc bit to 1, keep prev_alloc bit, and keep 0 in quick_list bit.
-                    clear_payload_size(curr_blk);
-                    add_blk_sizes(curr_blk, (uint64_t) get_blk_size(curr_blk), (uint64_t) payload_size);
-                    add_info_bits(curr_blk, 4);
-
-                    // Adjust header of next block: set prev_alloc bit to 1.
-                    struct sf_block* next_blk = (sf_block*) ((void *) curr_blk + get_blk_size(curr_blk));
-                    add_info_bits(next_blk, 2);
-
-                    // Set next block's footer to match if it is free.
-                    if(get_info_bits(next_blk) < 4) {
-                    	void* next_next_blk_start = (((void*) next_blk) + get_blk_size(next_blk));
-                    	struct sf_block* next_next_blk = (sf_block*) next_next_blk_start;
-                    	next_next_blk->prev_footer = next_blk->header;
-                    }
-
-                    return &(curr_blk->body.payload);
-                }
+    struct sf_block* curr_blk = find_free_list_fit(blk_size);
 
-                curr_blk = curr_blk->body.links.next;
-            }
+    // Merging the blocks of deferred frees may produce a fit without extending the heap.
+    if(!curr_blk && cur_arena->pending_frees) {
+        coalesce_heap();
+        curr_blk = find_free_list_fit(blk_size);
+    }
+    if(!curr_blk) {curr_blk = grow_heap(blk_size);}
+    if(!curr_blk) {return NULL;}
+
+    // If satisfactory block is found but it can be split without a splinter.
+    if(get_blk_size(curr_blk) >= (blk_size + 32)) {
+        struct sf_block* alloc_blk = split_free_block(curr_blk, blk_size, payload_size);
+        return &(alloc_blk->body.payload);
+    }
+
+    // Satisfactory block is of exact same size, or it cannot be split without a splinter.
+    alloc_free_block(curr_blk, payload_size);
+    return &(curr_blk->body.payload);
+}
+
+// Given a valid free block, remove it from the free lists and allocate all of it.
+void alloc_free_block(sf_block* blk, uint32_t payload_size) {
+    uint64_t blk_size = get_blk_size(blk);
+    delete_free_list_blk(blk, blk_size);
+
+    // Adjust header of the removed block: set alloc bit to 1, keep prev_alloc bit, and keep 0 in quick_list bit.
+    set_blk_header(blk, blk_size, payload_size, get_info_bits(blk) | 4);
+
+    // Adjust header of next block: set prev_alloc bit to 1.
+    struct sf_block* next_blk = (sf_block*) ((void *) blk + blk_size);
+    add_info_bits(next_blk, 2);
+
+    // Set next block's footer to match if it is free.
+    if(get_info_bits(next_blk) < 4) {
+        void* next_next_blk_start = (((void*) next_blk) + get_blk_size(next_blk));
+        struct sf_block* next_next_blk = (sf_block*) next_next_blk_start;
+        next_next_blk->prev_footer = next_blk->header;
+    }
+}
+
+// Given a free block and an alignment of at least 32, return the offset into the block of the first block whose payload
+// is aligned. The offset is 0, or at least 32 so that the bytes before it can form a free block of their own.
+static uint64_t aligned_blk_offset(sf_block* blk, uint32_t align) {
+    uint64_t payload = (uint64_t) &(blk->body.payload);
+    uint64_t offset = ((payload + align - 1) & ~((uint64_t) align - 1)) - payload;
+    if(offset && offset < 32) {offset += align;}
+    return offset;
+}
+
+// Given the size of a block and an alignment, return the first free block, in list order, that holds a block of that
+// size with an aligned payload, and set offset to where that block starts in it. Returns NULL if none does.
+static sf_block* find_aligned_fit(uint32_t blk_size, uint32_t align, uint64_t* offset) {
+    for(int i = get_free_list_idx(blk_size); i < NUM_FREE_LISTS; i++) {
+        struct sf_block* head = &cur_arena->free_list_heads[i];
+        for(struct sf_block* blk = head->body.links.next; blk != head; blk = blk->body.links.next) {
+            *offset = aligned_blk_offset(blk, align);
+            if(get_blk_size(blk) >= *offset + blk_size) {return blk;}
         }
-        if(add_mem_page() == - 1) {break;}
     }
     return NULL;
 }
 
+// Given the size of a block and an alignment of at least 32, carve a block whose payload is aligned out of a free block,
+// extending the heap if none holds one. The bytes before and after it are returned to the free lists, unless they are
+// too few to form a block, in which case those after it stay in the allocated block. If heap space is exhausted, return NULL.
+void* search_aligned_freelists(uint32_t blk_size, uint32_t payload_size, uint32_t align) {
+    // In the worst case the aligned block starts align + 16 bytes into the free block.
+    uint64_t worst_size = (uint64_t) blk_size + align + 32;
+    if(worst_size > UINT32_MAX) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+
+    uint64_t offset;
+    struct sf_block* curr_blk = find_aligned_fit(blk_size, align, &offset);
+    if(!curr_blk && cur_arena->pending_frees) {
+        coalesce_heap();
+        curr_blk = find_aligned_fit(blk_size, align, &offset);
+    }
+    if(!curr_blk) {
+        curr_blk = grow_heap(worst_size);
+        if(!curr_blk) {return NULL;}
+        offset = aligned_blk_offset(curr_blk, align);
+    }
+
+    // Leave the bytes before the aligned block free, or take the whole block if there are none.
+    if(offset) {curr_blk = split_free_block_high(curr_blk, get_blk_size(curr_blk) - offset, payload_size);}
+    else {alloc_free_block(curr_blk, payload_size);}
+
+    // Free the bytes after it.
+    split_alloc_block(curr_blk, blk_size, payload_size);
+    return &(curr_blk->body.payload);
+}
+
+// Given a valid free block, allocate up to count blocks of blk_size from its low end in one pass, and store their
+// payload addresses in out. The rest of the block stays free, unless it is too small to form a block, in which case
+// the last block takes it. Returns the number of blocks allocated, which is at least 1.
+int carve_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size, int count, void** out) {
+    uint64_t presplit_size = get_blk_size(blk);
+    uint64_t prev_alloc = get_info_bits(blk) & 2;
+    if(count > presplit_size / blk_size) {count = presplit_size / blk_size;}
+
+    uint64_t rest_size = presplit_size - (uint64_t) count * blk_size;
+    delete_free_list_blk(blk, presplit_size);
+
+    // Each block's predecessor is allocated, except perhaps the first one's.
+    for(int i = 0; i < count; i++) {
+        struct sf_block* alloc_blk = (sf_block*) (((void*) blk) + (uint64_t) i * blk_size);
+        uint64_t size = (i == count - 1 && rest_size < 32) ? blk_size + rest_size : blk_size;
+        set_blk_header(alloc_blk, size, payload_size, 4 | (i ? 2 : prev_alloc));
+        out[i] = &(alloc_blk->body.payload);
+    }
+
+    struct sf_block* next_blk = (sf_block*) (((void*) blk) + presplit_size);
+    if(rest_size < 32) {
+        // Adjust header of next block: set prev_alloc bit to 1.
+        add_info_bits(next_blk, 2);
+
+        // Set next block's footer to match if it is free.
+        if(get_info_bits(next_blk) < 4) {
+            void* next_next_blk_start = (((void*) next_blk) + get_blk_size(next_blk));
+            struct sf_block* next_next_blk = (sf_block*) next_next_blk_start;
+            next_next_blk->prev_footer = next_blk->header;
+        }
+        return count;
+    }
+
+    // The rest becomes a free block, whose footer is the next block's prev_footer. The next block's prev_alloc bit is already 0.
+    struct sf_block* rest_blk = (sf_block*) (((void*) blk) + (uint64_t) count * blk_size);
+    set_blk_header(rest_blk, rest_size, 0, 2);
+    next_blk->prev_footer = rest_blk->header;
+    add_free_list_blk(rest_blk, rest_size);
+
+    trace(TRACE_SPLIT, blk, (uint64_t) count * blk_size);
+    cur_arena->splits++;
+
+    return count;
+}
+
 // Given a pointer to the payload of a block, check if the pointer is valid. Then check if the block can be freed.
 int validate_block(void* ptr) {
     // If pointer is NULL or not 16 byte aligned, return -1.
     if(!ptr ||((uint64_t) ptr) % 16 != 0) {return -1;}
 
-    // If the header of the block preceeds the header of the first block in the heap, return -1.
+    // If the block is outside every arena's heap, or its header preceeds the header of the first block in its arena, return -1.
     uint64_t blk_start = ((uint64_t) ptr) - 16;
-    uint64_t first_blk_start = ((uint64_t) sf_mem_start()) + 8;
+    struct sf_arena* arena = arena_of((void*) blk_start);
+    if(!arena) {return -1;}
+    uint64_t first_blk_start = ((uint64_t) arena_mem_start(arena)) + 8;
     if(blk_start < first_blk_start) {return -1;}
 
+    // The header is read once, without the arena's lock. Only its size and alloc bits are relied on.
+    uint64_t header = load_blk_header((sf_block*) ((void *) blk_start));
+
     // If the block size is less than 32 or not a multiple of 16, return -1.
-    struct sf_block* blk = (sf_block*) ((void *) blk_start);
-    if(get_blk_size(blk) < 32 || (get_blk_size(blk) % 16 != 0)) {return -1;}
+    uint64_t blk_size = header & 0x00000000FFFFFFF0;
+    if(blk_size < 32 || (blk_size % 16 != 0)) {return -1;}
 
     // If the block is free, return -1;
-    if(get_info_bits(blk) < 4) {return -1;}
+    if(!(header & 4)) {return -1;}
 
     return 0;
 }
 
 // Given a valid free block of memory, split it into two blocks, one of req_size and the other of blk_size - req_size.
-void split_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size) {
+// Returns the allocated part. This is the lower part, unless the placement policy splits blocks of this size from the top.
+sf_block* split_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size) {
+    if(placement_policy.split_high_min && blk_size >= placement_policy.split_high_min) {
+        return split_free_block_high(blk, blk_size, payload_size);
+    }
+
     uint64_t presplit_size = get_blk_size(blk);
 
     // The lower block will be returned for caller usage.
-    clear_blk_sizes(blk);
-    add_blk_sizes(blk, (uint64_t) blk_size, (uint64_t) payload_size);
-    add_info_bits(blk, 4);
+    set_blk_header(blk, blk_size, payload_size, get_info_bits(blk) | 4);
 
     // Higher block will be resized.
     void* higher_blk_start = (((void *) blk) + blk_size);
     struct sf_block* higher_blk = (sf_block*) higher_blk_start;
-    clear_blk_sizes(higher_blk);
-    clear_info_bits(higher_blk);
-    add_blk_sizes(higher_blk, (uint64_t) (presplit_size - blk_size), 0);
-    add_info_bits(higher_blk, 2);
+    set_blk_header(higher_blk, presplit_size - blk_size, 0, 2);
 
     // Set footer of higher block.
     void* next_blk_start = ((void*) higher_blk + get_blk_size(higher_blk));
@@ -400,6 +781,44 @@ void split_free_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size) {
     // Delete old free block from lists, add new free block to lists.
     delete_free_list_blk(blk, presplit_size);
     add_free_list_blk(higher_blk, (presplit_size - blk_size));
+
+    trace(TRACE_SPLIT, blk, blk_size);
+    cur_arena->splits++;
+
+    return blk;
+}
+
+// Given a valid free block of memory, allocate its top blk_size bytes and leave the lower part free. Returns the allocated part.
+sf_block* split_free_block_high(sf_block* blk, uint32_t blk_size, uint32_t payload_size) {
+    uint64_t presplit_size = get_blk_size(blk);
+    uint64_t lower_size = presplit_size - blk_size;
+
+    // The lower block stays free and keeps its prev_alloc bit.
+    set_blk_header(blk, lower_size, 0, get_info_bits(blk));
+
+    // The higher block is allocated. Its previous block is the free lower block.
+    struct sf_block* higher_blk = (sf_block*) (((void *) blk) + lower_size);
+    higher_blk->prev_footer = blk->header;
+    set_blk_header(higher_blk, blk_size, payload_size, 4);
+
+    // Adjust header of next block: set prev_alloc bit to 1.
+    struct sf_block* next_blk = (sf_block*) (((void *) higher_blk) + blk_size);
+    add_info_bits(next_blk, 2);
+
+    // Set next block's footer to match if it is free.
+    if(get_info_bits(next_blk) < 4) {
+        void* next_next_blk_start = ((void*) next_blk) + get_blk_size(next_blk);
+        struct sf_block* next_next_blk = (sf_block*) next_next_blk_start;
+        next_next_blk->prev_footer = next_blk->header;
+    }
+
+    // The lower block shrank, so it may belong to a different free list.
+    relocate_free_list_blk(blk, presplit_size, lower_size);
+
+    trace(TRACE_SPLIT, blk, lower_size);
+    cur_arena->splits++;
+
+    return higher_blk;
 }
 
 void split_alloc_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size) {
@@ -408,28 +827,26 @@ void split_alloc_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size)
     // If splinter, do not create free block.
     if((presplit_size - blk_size) < 32) {
         // Adjust header and return.
-        clear_blk_sizes(blk);
-        add_blk_sizes(blk, presplit_size, (uint64_t) payload_size);
+        set_blk_header(blk, presplit_size, payload_size, get_info_bits(blk));
         return;
     }
 
     // The lower part of the block will be adjusted and returned.
-    clear_blk_sizes(blk);
-    add_blk_sizes(blk, (uint64_t) blk_size, (uint64_t) payload_size);
+    set_blk_header(blk, blk_size, payload_size, get_info_bits(blk));
 
     // The higher part of the block will be freed.
     void* higher_blk_start = (((void *) blk) + blk_size);
     struct sf_block* higher_blk = (sf_block*) higher_blk_start;
-    clear_blk_sizes(higher_blk);
-    clear_info_bits(higher_blk);
-    add_blk_sizes(higher_blk, (uint64_t) (presplit_size - blk_size), 0);
-    add_info_bits(higher_blk, 2);
+    set_blk_header(higher_blk, presplit_size - blk_size, 0, 2);
 
     // Set footer of higher block.
     void* next_blk_start = ((void*) higher_blk + get_blk_size(higher_blk));
     struct sf_block* next_blk = (sf_block*) next_blk_start;
     next_blk->prev_footer = higher_blk->header;
 
+    // Set next block's prev_alloc bit to 0.
+    keep_info_bits(next_blk, 5);
+
     // Set next block's footer to match if it is free.
     if(get_info_bits(next_blk) < 4) {
         void* next_next_blk_start = ((void*) next_blk) + get_blk_size(next_blk);
@@ -440,10 +857,71 @@ void split_alloc_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size)
     // Add new free block to lists.
     add_free_list_blk(higher_blk, (presplit_size - blk_size));
 
+    trace(TRACE_SPLIT, blk, blk_size);
+    cur_arena->splits++;
+
+    // With deferred coalescing, the block is merged by the next sweep of the heap.
+    if(coalesce_threshold) {
+        if(++cur_arena->pending_frees >= coalesce_threshold) {coalesce_heap();}
+        return;
+    }
+
     // Coalesce with adjacent blocks if applicable.
     coalesce_next_blk(higher_blk);
 }
 
+// Given a valid allocated block, grow it in place to blk_size by absorbing the free block after it, extending the heap
+// first if that free block is the wilderness or the block is the last in the heap. Any excess is split off and freed.
+// Returns 0 on success, or -1 if the block cannot grow in place, in which case the heap may have been extended.
+int grow_alloc_block(sf_block* blk, uint32_t blk_size, uint32_t payload_size) {
+    uint64_t curr_size = get_blk_size(blk);
+    struct sf_block* next_blk = (sf_block*) (((void*) blk) + curr_size);
+
+    // Merge the run of free blocks after the block, which may be longer than one with deferred coalescing.
+    uint64_t next_size = 0;
+    if(get_info_bits(next_blk) < 4) {
+        do {
+            next_size = get_blk_size(next_blk);
+            coalesce_next_blk(next_blk);
+        } while(get_blk_size(next_blk) != next_size);
+    }
+
+    // If the block is last, or only the wilderness follows it, extend the heap by what is missing.
+    if(curr_size + next_size < blk_size) {
+        struct sf_block* epilogue_blk = (sf_block*) (arena_mem_end(cur_arena) - 16);
+        if((void*) next_blk + next_size != (void*) epilogue_blk) {return -1;}
+
+        // A failure here is not final, as the caller falls back to a new block.
+        int saved_errno = sf_errno;
+        struct sf_block* wilderness = grow_heap(blk_size - curr_size);
+        sf_errno = saved_errno;
+        if(!wilderness) {return -1;}
+
+        next_blk = wilderness;
+        next_size = get_blk_size(wilderness);
+    }
+
+    // Absorb the free block.
+    delete_free_list_blk(next_blk, next_size);
+    set_blk_header(blk, curr_size + next_size, payload_size, get_info_bits(blk));
+
+    // Adjust header of next block: set prev_alloc bit to 1.
+    struct sf_block* after_blk = (sf_block*) (((void*) blk) + curr_size + next_size);
+    add_info_bits(after_blk, 2);
+
+    // Set next block's footer to match if it is free.
+    if(get_info_bits(after_blk) < 4) {
+        void* after_next_blk_start = ((void*) after_blk) + get_blk_size(after_blk);
+        struct sf_block* after_next_blk = (sf_block*) after_next_blk_start;
+        after_next_blk->prev_footer = after_blk->header;
+    }
+
+    // Return what the request does not need to the free lists.
+    split_alloc_block(blk, blk_size, payload_size);
+
+    return 0;
+}
+
 // Given a block, attempt to coalesce with previous block.
 sf_block* coalesce_prev_blk(sf_block* blk) {
     // Do not coalesce if previous block is allocated.
@@ -454,21 +932,24 @@ sf_block* coalesce_prev_blk(sf_block* blk) {
     uint64_t current_size = get_blk_size(blk);
     uint64_t merge_size = prev_size + current_size;
 
+    // Remove old block from free lists. This is done before any header changes, while every block still in the
+    // lists describes its own size correctly.
+    delete_free_list_blk(blk, current_size);
+
     // Create merged block.
     struct sf_block* merged_block = (sf_block*) (((void *) blk) - prev_size);
-    clear_blk_sizes(merged_block);
-    add_blk_sizes(merged_block, (uint64_t) merge_size, 0);
+    set_blk_header(merged_block, merge_size, 0, get_info_bits(merged_block));
 
     // Replace next block's prev_footer field with updated information.
     struct sf_block* next_blk = (sf_block*) (((void *) merged_block) + merge_size);
     next_blk->prev_footer = merged_block->header;
 
-    // Remove old block from free lists.
-    delete_free_list_blk(blk, current_size);
-
     // If the merged block no longer belongs to the same free list due to an increase in size, move to appropriate free list.
     relocate_free_list_blk(merged_block, prev_size, merge_size);
 
+    trace(TRACE_COALESCE, merged_block, merge_size);
+    cur_arena->coalesces++;
+
     return merged_block;
 }
 
@@ -484,17 +965,39 @@ void coalesce_next_blk(sf_block* blk) {
     uint64_t next_size = get_blk_size(next_blk);
     uint64_t merge_size = current_size + next_size;
 
+    // Remove old block from free lists before any header changes.
+    delete_free_list_blk(next_blk, next_size);
+
     // Create merged block.
-    clear_blk_sizes(blk);
-    add_blk_sizes(blk, (uint64_t) merge_size, 0);
+    set_blk_header(blk, merge_size, 0, get_info_bits(blk));
 
     // Replace block after merged block's prev_footer field with updated information.
     struct sf_block* merged_next_blk = (sf_block*) (((void *) blk) + merge_size);
     merged_next_blk->prev_footer = blk->header;
 
-    // Remove old block from free lists.
-    delete_free_list_blk(next_blk, next_size);
-
     // If the merged block no longer belongs to the same free list due to an increase in size, move to appropriate free list.
     relocate_free_list_blk(blk, current_size, merge_size);
-}
\ No newline at end of file
+
+    trace(TRACE_COALESCE, blk, merge_size);
+    cur_arena->coalesces++;
+}
+
+// Merges every run of adjacent free blocks in the current arena, in one pass in address order, and clears its pending frees.
+void coalesce_heap() {
+    // Start after the prologue. The epilogue is the only block of size 0.
+    struct sf_block* blk = (sf_block*) (arena_mem_start(cur_arena) + 32);
+    while(get_blk_size(blk)) {
+        if(get_info_bits(blk) < 4) {
+            uint64_t size;
+            do {
+                size = get_blk_size(blk);
+                coalesce_next_blk(blk);
+            } while(get_blk_size(blk) != size);
+        }
+
+        void* next_blk_start = ((void*) blk) + get_blk_size(blk);
+        blk = (sf_block*) next_blk_start;
+    }
+
+    cur_arena->pending_frees = 0;
+}
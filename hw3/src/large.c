@@ -0,0 +1,203 @@
+#define _GNU_SOURCE
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <sys/mman.h>
+#include "sfmm.h"
+#include "arena.h"
+#include "large.h"
+#include "ptrtable.h"
+
+// Compile-time default for the request size above which blocks are mapped directly. 0 disables direct mapping.
+#ifndef SF_MMAP_THRESHOLD
+#define SF_MMAP_THRESHOLD (128 * 1024)
+#endif
+
+// Mappings start on a boundary of at least this many bytes.
+#define LARGE_ALIGN 4096
+
+// Identifies the header of a large block. It is XORed with the header's address.
+#define LARGE_MAGIC 0x1A26E1A26E1A26EBull
+
+size_t large_threshold = SF_MMAP_THRESHOLD;
+
+#ifdef SF_THREADS
+#include <pthread.h>
+
+static pthread_mutex_t aligned_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define aligned_lock() pthread_mutex_lock(&aligned_mutex)
+#define aligned_unlock() pthread_mutex_unlock(&aligned_mutex)
+#else
+#define aligned_lock()
+#define aligned_unlock()
+#endif
+
+// Initial number of slots in the aligned payload table. Must be a power of two.
+#define ALIGNED_TABLE_MIN 64
+
+// The payloads that start a page. The header of such a payload is on the page before it, which an invalid pointer
+// that starts a page may not have mapped, so its header is only read once the pointer is found here.
+static struct ptrtable aligned_table;
+
+// Header just before a large block's payload. It is at the start of the mapping, unless the payload is aligned
+// to a page or more, in which case it ends the first page of the mapping.
+struct large_blk {
+    uint64_t magic;
+    void* map;                  // Start of the mapping.
+    size_t map_size;            // Size of the whole mapping.
+    sf_size_t size;             // Payload size.
+};
+
+// Returns the size of the mapping needed for a payload of the given size that starts offset bytes into it.
+static size_t large_map_size(size_t offset, sf_size_t size) {
+    return (offset + (size_t) size + LARGE_ALIGN - 1) & ~(size_t) (LARGE_ALIGN - 1);
+}
+
+// Returns nonzero if ptr is the payload of a large block that starts a page.
+static int aligned_contains(void* ptr) {
+    aligned_lock();
+    int found = ptrtable_find(&aligned_table, ptr, NULL) == 0;
+    aligned_unlock();
+    return found;
+}
+
+// Adds ptr, a payload that starts a page. Returns -1 if the table has no room for it.
+static int aligned_add(void* ptr) {
+    aligned_lock();
+    int status = -1;
+    if(aligned_table.slots || ptrtable_map(&aligned_table, ALIGNED_TABLE_MIN) == 0) {
+        if(ptrtable_grow(&aligned_table) == 0) {status = ptrtable_insert(&aligned_table, ptr, 0);}
+    }
+    aligned_unlock();
+    return status;
+}
+
+// Replaces old_ptr, a payload that starts a page, with new_ptr, or removes it if new_ptr is NULL. The number of
+// payloads does not grow, so this cannot fail.
+static void aligned_replace(void* old_ptr, void* new_ptr) {
+    aligned_lock();
+    ptrtable_remove(&aligned_table, old_ptr, NULL);
+    if(new_ptr) {ptrtable_insert(&aligned_table, new_ptr, 0);}
+    aligned_unlock();
+}
+
+// Returns nonzero if the given address is placed like the payload of a large block: just after a header at a
+// mapping boundary, or at a page boundary, outside every arena and the slabs. Its header is not checked.
+int large_owns(void* ptr) {
+    if(!ptr) {return 0;}
+    if(((uintptr_t) ptr - LARGE_HDR_SIZE) % LARGE_ALIGN != 0 && (uintptr_t) ptr % LARGE_ALIGN != 0) {return 0;}
+    return !arena_of(ptr - 16);
+}
+
+// Writes the header of a large block whose payload is at ptr in the given mapping, and returns ptr.
+static void* large_init(void* map, size_t map_size, void* ptr, sf_size_t size) {
+    struct large_blk* blk = (struct large_blk*) (ptr - LARGE_HDR_SIZE);
+    blk->magic = LARGE_MAGIC ^ (uint64_t) blk;
+    blk->map = map;
+    blk->map_size = map_size;
+    blk->size = size;
+    return ptr;
+}
+
+// Given a request size, map a block for it. Returns NULL if the size is not above the threshold or the mapping fails.
+void* large_malloc(sf_size_t size) {
+    size_t threshold = __atomic_load_n(&large_threshold, __ATOMIC_RELAXED);
+    if(!threshold || size <= threshold) {return NULL;}
+
+    size_t map_size = large_map_size(LARGE_HDR_SIZE, size);
+    void* map = mmap(NULL, map_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(map == MAP_FAILED) {return NULL;}
+
+    return large_init(map, map_size, map + LARGE_HDR_SIZE, size);
+}
+
+// Like large_malloc, but the payload is aligned to align, a power of two. A payload aligned to more than the header
+// size starts a page, after a page that holds its header. The mapping is made large enough to find such a page in it,
+// and then trimmed to it, so only the header page is spent on the alignment.
+void* large_memalign(sf_size_t size, sf_size_t align) {
+    if(align <= LARGE_HDR_SIZE) {return large_malloc(size);}
+
+    size_t threshold = __atomic_load_n(&large_threshold, __ATOMIC_RELAXED);
+    if(!threshold || size <= threshold) {return NULL;}
+
+    size_t map_size = large_map_size(LARGE_ALIGN, size);
+    size_t slack = (align > LARGE_ALIGN) ? align - LARGE_ALIGN : 0;
+    void* map = mmap(NULL, map_size + slack, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(map == MAP_FAILED) {return NULL;}
+
+    void* ptr = (void*) (((uintptr_t) map + LARGE_ALIGN + align - 1) & ~((uintptr_t) align - 1));
+    void* start = ptr - LARGE_ALIGN;
+    if(start > map) {munmap(map, start - map);}
+    if(map + slack > start) {munmap(start + map_size, map + slack - start);}
+
+    if(aligned_add(ptr) == -1) {
+        munmap(start, map_size);
+        return NULL;
+    }
+
+    return large_init(start, map_size, ptr, size);
+}
+
+// Given the payload of a large block, return its header, or NULL if the header is not valid.
+static struct large_blk* large_blk_of(void* ptr) {
+    if((uintptr_t) ptr % LARGE_ALIGN == 0 && !aligned_contains(ptr)) {return NULL;}
+
+    struct large_blk* blk = (struct large_blk*) (ptr - LARGE_HDR_SIZE);
+    if(blk->magic != (LARGE_MAGIC ^ (uint64_t) blk)) {return NULL;}
+    return blk;
+}
+
+// Given a payload address placed like a large block's, unmap the block. Returns -1 if it is not a large block.
+int large_free(void* ptr) {
+    struct large_blk* blk = large_blk_of(ptr);
+    if(!blk) {return -1;}
+
+    // Clear the magic number first, in case the unmapped range is mapped again before a stale pointer is freed.
+    if((uintptr_t) ptr % LARGE_ALIGN == 0) {aligned_replace(ptr, NULL);}
+    blk->magic = 0;
+    munmap(blk->map, blk->map_size);
+
+    return 0;
+}
+
+// Given a payload address placed like a large block's, resize the block. Aborts if it is not a large block.
+// A block that shrinks to the threshold or below moves to the heap if the heap has room. Otherwise the mapping
+// is resized, moving it if needed. Returns NULL and leaves the block untouched if the resize fails.
+void* large_realloc(void* ptr, sf_size_t rsize) {
+    struct large_blk* blk = large_blk_of(ptr);
+    if(!blk) {abort();}
+
+    if(rsize <= __atomic_load_n(&large_threshold, __ATOMIC_RELAXED)) {
+        int saved_errno = sf_errno;
+        void* new_ptr = sf_malloc(rsize);
+        if(new_ptr) {
+            memcpy(new_ptr, ptr, rsize);
+            large_free(ptr);
+            return new_ptr;
+        }
+        sf_errno = saved_errno;
+    }
+
+    // The payload keeps its offset into the mapping, so a moved block keeps its alignment to the page.
+    size_t offset = ptr - blk->map;
+    size_t map_size = large_map_size(offset, rsize);
+    if(map_size == blk->map_size) {
+        blk->size = rsize;
+        return ptr;
+    }
+
+    void* map = mremap(blk->map, blk->map_size, map_size, MREMAP_MAYMOVE);
+    if(map == MAP_FAILED) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    if((uintptr_t) ptr % LARGE_ALIGN == 0 && map + offset != ptr) {aligned_replace(ptr, map + offset);}
+    return large_init(map, map_size, map + offset, rsize);
+}
+
+// Given a payload address placed like a large block's, return the bytes usable from it, or 0 if it is not a large block.
+size_t large_usable_size(void* ptr) {
+    struct large_blk* blk = large_blk_of(ptr);
+    return blk ? (size_t) (blk->map + blk->map_size - ptr) : 0;
+}
@@ -0,0 +1,104 @@
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <sys/mman.h>
+#include "ptrtable.h"
+
+// Keys are at least 16-byte aligned, and often page-aligned, so the high half of the product is folded into the low
+// bits the slot is taken from.
+static size_t ptrtable_hash(struct ptrtable* table, void* key) {
+    uint64_t hash = ((uintptr_t) key >> 4) * 0x9E3779B97F4A7C15ull;
+    return (size_t) (hash ^ (hash >> 32)) & (table->size - 1);
+}
+
+// Maps an empty table of the given number of slots, a power of two. Returns -1 if it cannot be mapped.
+int ptrtable_map(struct ptrtable* table, size_t size) {
+    void* slots = mmap(NULL, size * sizeof(struct ptrtable_slot), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if(slots == MAP_FAILED) {return -1;}
+
+    table->slots = (struct ptrtable_slot*) slots;
+    table->size = size;
+    table->used = 0;
+    return 0;
+}
+
+void ptrtable_unmap(struct ptrtable* table) {
+    if(table->slots) {munmap(table->slots, table->size * sizeof(struct ptrtable_slot));}
+    table->slots = NULL;
+    table->size = 0;
+    table->used = 0;
+}
+
+// Makes room for one more key, doubling the table once it is half full. Returns -1 if a larger table cannot be
+// mapped, in which case the old one is kept.
+int ptrtable_grow(struct ptrtable* table) {
+    if(2 * (table->used + 1) <= table->size) {return 0;}
+
+    struct ptrtable old_table = *table;
+    if(ptrtable_map(table, 2 * old_table.size) == -1) {
+        *table = old_table;
+        return -1;
+    }
+    for(size_t i = 0; i < old_table.size; i++) {
+        if(old_table.slots[i].key) {ptrtable_insert(table, old_table.slots[i].key, old_table.slots[i].value);}
+    }
+    ptrtable_unmap(&old_table);
+    return 0;
+}
+
+// Sets the value of a key, adding the key if it is new. Returns -1 if the key is new and the table has no room.
+int ptrtable_insert(struct ptrtable* table, void* key, uint32_t value) {
+    size_t mask = table->size - 1;
+    size_t i = ptrtable_hash(table, key);
+    while(table->slots[i].key && table->slots[i].key != key) {i = (i + 1) & mask;}
+
+    if(!table->slots[i].key) {
+        // The last empty slot is kept, so that probes for missing keys end.
+        if(table->used + 1 >= table->size) {return -1;}
+        table->used++;
+    }
+    table->slots[i].key = key;
+    table->slots[i].value = value;
+    return 0;
+}
+
+// Returns the slot holding a key, or -1 if it is not in the table.
+static long ptrtable_slot_of(struct ptrtable* table, void* key) {
+    if(!table->slots) {return -1;}
+
+    size_t i = ptrtable_hash(table, key);
+    while(table->slots[i].key != key) {
+        if(!table->slots[i].key) {return -1;}
+        i = (i + 1) & (table->size - 1);
+    }
+    return (long) i;
+}
+
+// Looks up a key and stores its value in value, which may be NULL. Returns -1 if the key is not in the table.
+int ptrtable_find(struct ptrtable* table, void* key, uint32_t* value) {
+    long i = ptrtable_slot_of(table, key);
+    if(i == -1) {return -1;}
+
+    if(value) {*value = table->slots[i].value;}
+    return 0;
+}
+
+// Removes a key and stores its value in value, which may be NULL. Returns -1 if the key is not in the table.
+int ptrtable_remove(struct ptrtable* table, void* key, uint32_t* value) {
+    long i = ptrtable_slot_of(table, key);
+    if(i == -1) {return -1;}
+    if(value) {*value = table->slots[i].value;}
+
+    size_t mask = table->size - 1;
+    size_t hole = i;
+    for(size_t j = (i + 1) & mask; table->slots[j].key; j = (j + 1) & mask) {
+        // An entry can fill the hole if its home slot is not cyclically between the hole and itself.
+        size_t home = ptrtable_hash(table, table->slots[j].key);
+        if(((j - home) & mask) >= ((j - hole) & mask)) {
+            table->slots[hole] = table->slots[j];
+            hole = j;
+        }
+    }
+    table->slots[hole].key = NULL;
+    table->used--;
+    return 0;
+}
@@ -0,0 +1,182 @@
+#define _DEFAULT_SOURCE
+#include <stdlib.h>
+#include <string.h>
+#include <stdint.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "record.h"
+#include "ptrtable.h"
+#include "timing.h"
+
+#ifdef SF_THREADS
+#include <pthread.h>
+
+static pthread_mutex_t record_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define record_lock() pthread_mutex_lock(&record_mutex)
+#define record_unlock() pthread_mutex_unlock(&record_mutex)
+
+__thread int record_paused;
+#else
+#define record_lock()
+#define record_unlock()
+
+int record_paused;
+#endif
+
+// Initial number of slots in the id table. Must be a power of two.
+#define RECORD_TABLE_MIN 4096
+
+int record_on;
+
+static int record_fd = -1;
+static char record_buffer[RECORD_BUFFER];
+static size_t record_buffered;
+static uint32_t record_next_id;
+static uint64_t record_last_time;
+static int record_exit_registered;
+
+// Table from live payload addresses to object ids.
+static struct ptrtable record_table;
+
+// Writes out the buffered entries. Entries that cannot be written are dropped.
+static void record_flush() {
+    size_t written = 0;
+    while(written < record_buffered) {
+        ssize_t n = write(record_fd, record_buffer + written, record_buffered - written);
+        if(n <= 0) {break;}
+        written += n;
+    }
+    record_buffered = 0;
+}
+
+// Appends an entry for an event that just completed. The recorder must be locked.
+static void record_write(record_op op, uint32_t id, uint32_t size, int failed) {
+    uint64_t now = now_ns();
+    uint64_t delta = now - record_last_time;
+    record_last_time = now;
+
+    struct record_entry entry = {id, size, (delta > UINT32_MAX) ? UINT32_MAX : (uint32_t) delta, op, failed != 0, {0, 0}};
+    if(record_buffered + sizeof(entry) > RECORD_BUFFER) {record_flush();}
+    memcpy(record_buffer + record_buffered, &entry, sizeof(entry));
+    record_buffered += sizeof(entry);
+}
+
+// Takes a key out of the id table and returns its id, or RECORD_NO_ID if it is not in the table.
+static uint32_t record_table_remove(void* key) {
+    uint32_t id;
+    return (ptrtable_remove(&record_table, key, &id) == -1) ? RECORD_NO_ID : id;
+}
+
+// Each event checks that recording was not stopped while its call was running.
+void record_malloc(uint32_t size, void* ptr) {
+    record_lock();
+    if(record_fd == -1) {
+        record_unlock();
+        return;
+    }
+    uint32_t id = record_next_id++;
+    if(ptr) {
+        // If the table is full and cannot grow, the object goes untracked.
+        ptrtable_grow(&record_table);
+        ptrtable_insert(&record_table, ptr, id);
+    }
+    record_write(RECORD_MALLOC, id, size, !ptr);
+    record_unlock();
+}
+
+void record_free(void* ptr) {
+    record_lock();
+    uint32_t id = (record_fd == -1) ? RECORD_NO_ID : record_table_remove(ptr);
+    if(id != RECORD_NO_ID) {record_write(RECORD_FREE, id, 0, 0);}
+    record_unlock();
+}
+
+// Takes the id of a block about to be reallocated out of the table, so that its address can be reused by
+// other threads before the realloc completes. Returns RECORD_NO_ID if the block was allocated before recording.
+uint32_t record_realloc_begin(void* ptr) {
+    record_lock();
+    uint32_t id = (record_fd == -1) ? RECORD_NO_ID : record_table_remove(ptr);
+    record_unlock();
+    return id;
+}
+
+// Records a completed realloc. The object keeps its id at its new address. If the realloc failed, it keeps its old one.
+void record_realloc_end(uint32_t id, void* old_ptr, uint32_t size, void* new_ptr) {
+    if(id == RECORD_NO_ID) {return;}
+
+    record_lock();
+    if(record_fd == -1) {
+        record_unlock();
+        return;
+    }
+    void* ptr = (new_ptr || !size) ? new_ptr : old_ptr;
+    if(ptr) {
+        // If the table is full and cannot grow, the object goes untracked.
+        ptrtable_grow(&record_table);
+        ptrtable_insert(&record_table, ptr, id);
+    }
+    record_write(RECORD_REALLOC, id, size, size && !new_ptr);
+    record_unlock();
+}
+
+static void record_exit() {
+    sf_record_stop();
+}
+
+// Opens the trace file, writes its header and starts recording. Returns -1 if recording is on or the file cannot be created.
+int sf_record_start(const char *path) {
+    record_lock();
+    if(record_fd != -1) {
+        record_unlock();
+        return -1;
+    }
+
+    int fd = open(path, O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if(fd == -1) {
+        record_unlock();
+        return -1;
+    }
+    if(ptrtable_map(&record_table, RECORD_TABLE_MIN) == -1) {
+        close(fd);
+        record_unlock();
+        return -1;
+    }
+
+    struct record_header header = {{0}, RECORD_VERSION, sizeof(struct record_entry)};
+    memcpy(header.magic, RECORD_MAGIC, sizeof(header.magic));
+    record_fd = fd;
+    memcpy(record_buffer, &header, sizeof(header));
+    record_buffered = sizeof(header);
+    record_next_id = 0;
+    record_last_time = now_ns();
+
+    // A trace that is never stopped is still completed at exit.
+    if(!record_exit_registered) {
+        atexit(record_exit);
+        record_exit_registered = 1;
+    }
+
+    __atomic_store_n(&record_on, 1, __ATOMIC_RELAXED);
+    record_unlock();
+    return 0;
+}
+
+// Stops recording, writes out the remaining entries and closes the trace file. Returns -1 if not recording.
+int sf_record_stop() {
+    record_lock();
+    if(record_fd == -1) {
+        record_unlock();
+        return -1;
+    }
+
+    __atomic_store_n(&record_on, 0, __ATOMIC_RELAXED);
+    record_flush();
+    int status = close(record_fd);
+    record_fd = -1;
+    ptrtable_unmap(&record_table);
+    record_unlock();
+
+    return (status == 0) ? 0 : -1;
+}
@@ -9,63 +9,150 @@
 #include <stdint.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfmm_ext.h"
 #include "helper.h"
+#include "arena.h"
+#include "tcache.h"
+#include "slab.h"
+#include "large.h"
+#include "stats.h"
+#include "record.h"
+
+// Adds an allocated block to the current arena's payload counters, raising the peak if needed. The block is handed out
+// to be written, so the clean mark is raised past it and the header and links of the block after it.
+static void count_alloc_blk(sf_block* blk) {
+    cur_arena->payload += get_payload_size(blk);
+    cur_arena->payload_blk_size += get_blk_size(blk);
+    if(cur_arena->payload > cur_arena->peak_payload) {cur_arena->peak_payload = cur_arena->payload;}
+
+    void* written = ((void*) blk) + get_blk_size(blk) + 32;
+    if(written > cur_arena->clean) {cur_arena->clean = written;}
+}
 
-// Returns a pointer to allocated memory for the requested size. If the size is invalid, or there is not enough memory to satisfy the request, return NULL;
-void *sf_malloc(sf_size_t size) {
-    if(size <= 0) return NULL;
+// Removes an allocated block from the current arena's payload counters.
+static void count_free_blk(sf_block* blk) {
+    cur_arena->payload -= get_payload_size(blk);
+    cur_arena->payload_blk_size -= get_blk_size(blk);
+}
 
-    // Calculating block size for request.
-    uint32_t blk_size = get_req_blk_size(size);
+// Allocates a block of blk_size for a payload of size from the current arena. Returns NULL if there is not enough memory.
+// In a threaded build, the arena must be locked.
+void* heap_malloc(uint32_t blk_size, sf_size_t size) {
+    // If first allocation from the arena, then perform heap setup.
+    if(arena_mem_start(cur_arena) == arena_mem_end(cur_arena)) {
+        if(init_heap() == -1) {return NULL;}
+    }
+
+    // Return valid pointer if a quick list block can satisfy request. Otherwise, try the free lists.
+    void* ptr = search_quicklists(blk_size, size);
+    if(!ptr) {ptr = search_freelists(blk_size, size);}
+
+    // Not enough memory to satisfy request.
+    if(!ptr) {return NULL;}
 
-    // If first call to sf_malloc, then perform heap setup.
-    if(sf_mem_start() == sf_mem_end()) {
+    count_alloc_blk((sf_block*) (ptr - 16));
+    return ptr;
+}
+
+// Like heap_malloc, but the first size bytes of the payload are zeroed. The heap is already zero from the clean mark on,
+// apart from the word that held the footer of the free block the payload came from, so only the rest is cleared.
+void* heap_calloc(uint32_t blk_size, sf_size_t size) {
+    if(arena_mem_start(cur_arena) == arena_mem_end(cur_arena)) {
         if(init_heap() == -1) {return NULL;}
     }
 
-    // Return valid pointer if a quick list block can satisfy request.
-    void* quick_list_ptr = search_quicklists(blk_size, size);
-    if(quick_list_ptr) {return quick_list_ptr;}
+    void* ptr = search_quicklists(blk_size, size);
+    if(!ptr) {ptr = search_freelists(blk_size, size);}
+    if(!ptr) {return NULL;}
 
-    // Return valid pointer if a free list block can satisfy request.
-    void* free_list_ptr = search_freelists(blk_size, size);
-    if(free_list_ptr) {return free_list_ptr;}
+    struct sf_block* blk = (sf_block*) (ptr - 16);
+    void* end = ptr + size;
+    void* clean = cur_arena->clean;
+    void* footer = ((void*) blk) + get_blk_size(blk);
+    void* dirty_end = (clean < end) ? clean : end;
+    if(dirty_end > ptr) {memset(ptr, 0, dirty_end - ptr);}
+    if(footer >= clean && footer < end) {memset(footer, 0, end - footer);}
 
-    // Not enough memory to satisfy request.
-    return NULL;
+    count_alloc_blk(blk);
+    return ptr;
 }
 
-// Frees allocated memory for the given block. If the pointer is invalid, the program is aborted.
-void sf_free(void *pp) {
-    // Check if pointer and block are valid for freeing.
-    if(validate_block(pp) == -1) {abort();}
+// Like heap_malloc, but the payload is aligned to align, a power of two of at least 32. Quick lists are not searched.
+void* heap_memalign(uint32_t blk_size, sf_size_t size, uint32_t align) {
+    if(arena_mem_start(cur_arena) == arena_mem_end(cur_arena)) {
+        if(init_heap() == -1) {return NULL;}
+    }
 
-    // Check if the block will be put in quick lists or free lists.
-    void* blk_start = pp - 16;
-    struct sf_block* blk = (sf_block*) blk_start;
+    void* ptr = search_aligned_freelists(blk_size, size, align);
+    if(!ptr) {return NULL;}
+
+    count_alloc_blk((sf_block*) (ptr - 16));
+    return ptr;
+}
+
+// Allocates count blocks of blk_size for payloads of size from the current arena, and stores their payload addresses in
+// out. Quick list blocks are taken first, and the rest are carved from the low ends of as few free blocks as possible,
+// whatever the placement policy. Returns the number allocated, which is less than count only if there is not enough
+// memory. In a threaded build, the arena must be locked.
+int heap_malloc_batch(uint32_t blk_size, sf_size_t size, int count, void** out) {
+    if(arena_mem_start(cur_arena) == arena_mem_end(cur_arena)) {
+        if(init_heap() == -1) {return 0;}
+    }
+
+    int done = 0;
+    while(done < count && (out[done] = search_quicklists(blk_size, size))) {count_alloc_blk((sf_block*) (out[done++] - 16));}
+
+    while(done < count) {
+        // Look for a free block that holds all the blocks still wanted, and settle for one that holds a single block.
+        uint64_t want_size = (uint64_t) blk_size * (count - done);
+        struct sf_block* blk = (want_size <= UINT32_MAX) ? find_free_list_fit(want_size) : NULL;
+        if(!blk && cur_arena->pending_frees) {
+            coalesce_heap();
+            if(want_size <= UINT32_MAX) {blk = find_free_list_fit(want_size);}
+        }
+        if(!blk) {blk = find_free_list_fit(blk_size);}
+        if(!blk && want_size <= UINT32_MAX) {
+            // Growing by all the blocks still wanted is only an attempt, so its failure is not an error.
+            int saved_errno = sf_errno;
+            blk = grow_heap(want_size);
+            sf_errno = saved_errno;
+        }
+        if(!blk) {blk = grow_heap(blk_size);}
+        if(!blk) {break;}
+
+        // The blocks are counted at once, since growing the heap again relies on the clean mark being past them.
+        int carved = carve_free_block(blk, blk_size, size, count - done, out + done);
+        for(int i = done; i < done + carved; i++) {count_alloc_blk((sf_block*) (out[i] - 16));}
+        done += carved;
+    }
+
+    return done;
+}
+
+// Puts a valid allocated block, already removed from the payload counters, on a quick list or the free lists.
+static void release_blk(sf_block* blk) {
+    uint64_t blk_size = get_blk_size(blk);
 
     // Put in quick list.
-    if(get_quick_list_idx(get_blk_size(blk)) != -1) {
+    if(get_quick_list_idx(blk_size) != -1) {
         // Set quick list bit to 1. (Leave alloc bit as 1 and prev_alloc bit as it was.)
-        clear_payload_size(blk);
-        add_info_bits(blk, 1);
+        set_blk_header(blk, blk_size, 0, get_info_bits(blk) | 1);
 
         // Add block to quick lists.
-        add_quick_list_blk(blk, get_blk_size(blk));
+        add_quick_list_blk(blk, blk_size);
     }
     // Put in free list.
     else {
         // Set alloc bit to 0. Leave quick list bit as 0 and prev_alloc bit as it was.)
-        clear_payload_size(blk);
-        blk->header = (((blk->header) ^ MAGIC) & 0xFFFFFFFFFFFFFFF3) ^ MAGIC;
+        set_blk_header(blk, blk_size, 0, get_info_bits(blk) & 3);
 
         // Set footer to match header.
-        void* next_blk_start = ((void*) blk) + get_blk_size(blk);
+        void* next_blk_start = ((void*) blk) + blk_size;
         struct sf_block* next_blk = (sf_block*) next_blk_start;
         next_blk->prev_footer = blk->header;
 
         // Set next block's prev_alloc bit to 0.
-        next_blk->header = (((next_blk->header) ^ MAGIC) & 0xFFFFFFFFFFFFFFF5) ^ MAGIC;
+        keep_info_bits(next_blk, 5);
 
         // If next block has a footer, then set it to match changes.
         if(get_info_bits(next_blk) < 4) {
@@ -75,7 +162,13 @@ void sf_free(void *pp) {
         }
 
         // Add block to free lists.
-        add_free_list_blk(blk, get_blk_size(blk));
+        add_free_list_blk(blk, blk_size);
+
+        // With deferred coalescing, the block is merged by the next sweep of the heap.
+        if(coalesce_threshold) {
+            if(++cur_arena->pending_frees >= coalesce_threshold) {coalesce_heap();}
+            return;
+        }
 
         // Coalesce with adjacent blocks if applicable.
         struct sf_block* merge_prev = coalesce_prev_blk(blk);
@@ -88,16 +181,37 @@ void sf_free(void *pp) {
     }
 }
 
-void *sf_realloc(void *pp, sf_size_t rsize) {
-    // Free block is request size is 0.
-    if(rsize == 0) {
-        sf_free(pp);
-        return NULL;
+// Returns a valid allocated block to the current arena, which must be the one that contains it. In a threaded build, the arena must be locked.
+void heap_free(sf_block* blk) {
+    count_free_blk(blk);
+    release_blk(blk);
+}
+
+// Returns count valid allocated blocks that follow each other in memory, starting with blk, to the current arena, which
+// must be the one that contains them. They are merged into one block first, so it is put on the lists and coalesced
+// with its neighbours once. In a threaded build, the arena must be locked.
+void heap_free_run(sf_block* blk, int count) {
+    uint64_t run_size = 0;
+    for(int i = 0; i < count; i++) {
+        struct sf_block* run_blk = (sf_block*) (((void*) blk) + run_size);
+        count_free_blk(run_blk);
+        run_size += get_blk_size(run_blk);
     }
 
-    // Check if pointer and block are valid for reallocation.
-    if(validate_block(pp) == -1) {abort();}
+    set_blk_header(blk, run_size, 0, get_info_bits(blk));
+    cur_arena->coalesces += count - 1;
+    release_blk(blk);
+}
+
+// Returns how many bytes to copy when a valid allocated block moves to a new one for rsize bytes. The whole old block
+// is kept, not only its recorded payload, as a block that passed through a thread cache keeps a stale payload size.
+static uint64_t realloc_copy_size(sf_block* blk, sf_size_t rsize) {
+    uint64_t old_size = (load_blk_header(blk) & 0x00000000FFFFFFF0) - 8;
+    return (old_size < rsize) ? old_size : rsize;
+}
 
+// Resizes a valid allocated block within the current arena, which must be the one that contains it. In a threaded build, the arena must be locked.
+static void* heap_realloc(void *pp, sf_size_t rsize) {
     // Check if the request size is larger or smaller than the original size.
     void* blk_start = pp - 16;
     struct sf_block* blk = (sf_block*) blk_start;
@@ -113,20 +227,27 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
         if(old_payload_size == rsize) {return pp;}
 
         // Update header to reflect size change. Since size change is small, padding can be used to satisfy request.
-        clear_blk_sizes(blk);
-        add_blk_sizes(blk, old_blk_size, rsize);
+        count_free_blk(blk);
+        set_blk_header(blk, old_blk_size, rsize, get_info_bits(blk));
+        count_alloc_blk(blk);
         return pp;
     }
     else if(old_blk_size < new_blk_size) {
         // Request is greater.
 
+        // Grow in place if the next block is free or the heap can be extended behind the block.
+        count_free_blk(blk);
+        int grown = grow_alloc_block(blk, new_blk_size, rsize);
+        count_alloc_blk(blk);
+        if(grown == 0) {return pp;}
+
         // Copy old payload to new block.
-        void* new_blk_payload = sf_malloc(rsize);
+        void* new_blk_payload = heap_malloc(new_blk_size, rsize);
         if(!new_blk_payload) {return NULL;}
-        memcpy(new_blk_payload, pp, old_payload_size);
+        memcpy(new_blk_payload, pp, realloc_copy_size(blk, rsize));
 
         // Free old block.
-        sf_free(pp);
+        heap_free(blk);
 
         // Return new block's payload address.
         return new_blk_payload;
@@ -135,7 +256,9 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
         // Request is smaller.
 
         // Split block if possible.
+        count_free_blk(blk);
         split_alloc_block(blk, new_blk_size, rsize);
+        count_alloc_blk(blk);
 
         return pp;
     }
@@ -144,53 +267,559 @@ void *sf_realloc(void *pp, sf_size_t rsize) {
     return NULL;
 }
 
-double sf_internal_fragmentation() {
-    double payload = 0.0;
-    double blk_size = 0.0;
-    if(sf_mem_start() == sf_mem_end()) {return 0.0;}
+// Allocates from the current arena, aligning the payload if align is above 16, or else zeroing it if zero is set.
+static void* heap_alloc(uint32_t blk_size, sf_size_t size, uint32_t align, int zero) {
+    if(align > 16) {return heap_memalign(blk_size, size, align);}
+    return zero ? heap_calloc(blk_size, size) : heap_malloc(blk_size, size);
+}
 
-    struct sf_block* curr_blk = (sf_block*) sf_mem_start();
-    while(1) {
-        uint64_t curr_blk_size = get_blk_size(curr_blk);
-        uint64_t curr_payload_size = get_payload_size(curr_blk);
-        int alloc = (get_info_bits(curr_blk) < 4) ? 0 : 1;
-        if(curr_blk_size == 0 && curr_payload_size == 0 && alloc == 1) {
-            break;
+// Allocates from the calling thread's arena with heap_alloc. If that arena is out of memory, the other arenas in use
+// are tried in turn.
+static void* arena_malloc(uint32_t blk_size, sf_size_t size, uint32_t align, int zero) {
+    struct sf_arena* arena = arena_get();
+    void* ptr = heap_alloc(blk_size, size, align, zero);
+    arena_unlock(arena);
+
+    int limit = __atomic_load_n(&arena_limit, __ATOMIC_RELAXED);
+    for(int i = 0; !ptr && i < limit; i++) {
+        if(&arenas[i] == arena) {continue;}
+        arena_lock(&arenas[i]);
+        ptr = heap_alloc(blk_size, size, align, zero);
+        arena_unlock(&arenas[i]);
+    }
+
+    return ptr;
+}
+
+// Allocates memory for a request from a slab, a mapping of its own, or the heap, in that order.
+static void* malloc_blk(sf_size_t size) {
+    // In a slab build, small requests are served from slabs, falling back to the heap when none can be had.
+    void* ptr = slab_malloc(size);
+    if(ptr) {return ptr;}
+
+    // Requests above the mmap threshold get a mapping of their own.
+    ptr = large_malloc(size);
+    if(ptr) {return ptr;}
+
+    // Calculating block size for request.
+    uint32_t blk_size = get_req_blk_size(size);
+
+    // In a threaded build, small requests are served by the thread's cache without taking the heap lock.
+    ptr = tcache_malloc(blk_size);
+    if(!ptr) {
+        ptr = arena_malloc(blk_size, size, 16, 0);
+
+        // Blocks held in the thread's cache cannot be coalesced, so return them and try again.
+        if(!ptr && tcache_flush()) {ptr = arena_malloc(blk_size, size, 16, 0);}
+    }
+
+    return ptr;
+}
+
+// Allocates memory for a request whose payload must be aligned to align, a power of two. Alignments of up to 16 are
+// those of every payload. Larger ones skip the slabs and thread caches, whose blocks are not aligned beyond that.
+static void* memalign_blk(sf_size_t size, sf_size_t align) {
+    if(align <= 16) {return malloc_blk(size);}
+
+    void* ptr = large_memalign(size, align);
+    if(ptr) {return ptr;}
+
+    uint32_t blk_size = get_req_blk_size(size);
+    ptr = arena_malloc(blk_size, size, align, 0);
+    if(!ptr && tcache_flush()) {ptr = arena_malloc(blk_size, size, align, 0);}
+
+    return ptr;
+}
+
+// Allocates zeroed memory for a request, in the same order as malloc_blk. Mappings are fresh, and heap blocks are only
+// cleared below their arena's clean mark, so only slots and cached blocks, which are always recycled, are cleared whole.
+static void* calloc_blk(sf_size_t size) {
+    void* ptr = slab_malloc(size);
+    if(ptr) {return memset(ptr, 0, size);}
+
+    ptr = large_malloc(size);
+    if(ptr) {return ptr;}
+
+    uint32_t blk_size = get_req_blk_size(size);
+    ptr = tcache_malloc(blk_size);
+    if(ptr) {return memset(ptr, 0, size);}
+
+    ptr = arena_malloc(blk_size, size, 16, 1);
+    if(!ptr && tcache_flush()) {ptr = arena_malloc(blk_size, size, 16, 1);}
+
+    return ptr;
+}
+
+// Frees a valid allocated heap block of the given size.
+static void free_heap_blk(sf_block* blk, uint32_t blk_size) {
+    // In a threaded build, small blocks are kept in the thread's cache without taking the heap lock.
+    if(tcache_free_sized(blk, blk_size)) {return;}
+
+    // A block of another thread's arena is queued for that arena instead of taking its lock.
+    struct sf_arena* arena = arena_of(blk);
+    if(arena_is_remote(arena)) {
+        arena_remote_free(arena, blk);
+        return;
+    }
+
+    arena_lock(arena);
+    heap_free(blk);
+    arena_unlock(arena);
+}
+
+// Frees memory returned by malloc_blk. If the pointer is invalid, the program is aborted.
+static void free_blk(void* pp) {
+    // Slots of slabs have no block header, so they are checked and freed by the slab allocator.
+    if(slab_owns(pp)) {
+        trace(TRACE_FREE, pp, 0);
+        if(slab_free(pp) == -1) {abort();}
+        return;
+    }
+
+    // Large blocks are unmapped straight away.
+    if(large_owns(pp)) {
+        trace(TRACE_FREE, pp, 0);
+        if(large_free(pp) == -1) {abort();}
+        return;
+    }
+
+    // Check if pointer and block are valid for freeing.
+    if(validate_block(pp) == -1) {abort();}
+
+    void* blk_start = pp - 16;
+    struct sf_block* blk = (sf_block*) blk_start;
+    uint32_t blk_size = load_blk_header(blk) & 0x00000000FFFFFFF0;
+    trace(TRACE_FREE, pp, blk_size);
+
+    free_heap_blk(blk, blk_size);
+}
+
+#ifdef SF_HARDENED
+// Aborts the program unless the pointer is valid and size fits its block. For a heap block, size must also be the payload
+// size in the header, except that a thread cache does not keep the payload size of its blocks up to date, so there it
+// only has to fit in the block.
+static void check_free_size(void* pp, sf_size_t size) {
+    if(slab_owns(pp)) {
+        if(size > slab_usable_size(pp)) {abort();}
+        return;
+    }
+    if(large_owns(pp)) {
+        if(size > large_usable_size(pp)) {abort();}
+        return;
+    }
+    if(validate_block(pp) == -1) {abort();}
+
+    struct sf_block* blk = (sf_block*) (pp - 16);
+#ifdef SF_THREADS
+    if(size > (load_blk_header(blk) & 0x00000000FFFFFFF0) - 8) {abort();}
+#else
+    if(size != get_payload_size(blk)) {abort();}
+#endif
+}
+#endif
+
+// Frees memory returned by malloc_blk for a request of size bytes. A heap block whose header holds the block size that
+// size implies, with only the alloc and prev_alloc bits set, is freed without validate_block. Any other pointer takes
+// the free_blk path. In a hardened build (SF_HARDENED), every pointer is validated in full, and the program is aborted
+// if size is not the one it was allocated for.
+static void free_sized_blk(void* pp, sf_size_t size) {
+#ifdef SF_HARDENED
+    check_free_size(pp, size);
+#endif
+    if(slab_owns(pp) || large_owns(pp) || ((uintptr_t) pp) % 16 != 0) {
+        free_blk(pp);
+        return;
+    }
+
+    // The header is decoded once, after checking it is in a heap. A block that took a splinter is larger than size
+    // implies, so it is checked in full.
+    struct sf_block* blk = (sf_block*) (pp - 16);
+    if(!arena_of(blk)) {abort();}
+    uint32_t blk_size = get_req_blk_size(size);
+    if((load_blk_header(blk) & 0xFFFFFFF5) != (blk_size | 4)) {
+        free_blk(pp);
+        return;
+    }
+
+    trace(TRACE_FREE, pp, blk_size);
+    free_heap_blk(blk, blk_size);
+}
+
+// Allocates count blocks for requests of size, from the same places as malloc_blk, and stores them in out. Heap blocks
+// come from the thread's arena in one locked pass that skips the thread's cache. Returns the number allocated.
+static int malloc_batch_blk(sf_size_t size, int count, void** out) {
+    int done = 0;
+
+    // Slabs and mappings serve one request at a time.
+    while(done < count && (out[done] = slab_malloc(size))) {done++;}
+    while(done < count && (out[done] = large_malloc(size))) {done++;}
+
+    if(done < count) {
+        struct sf_arena* arena = arena_get();
+        done += heap_malloc_batch(get_req_blk_size(size), size, count - done, out + done);
+        arena_unlock(arena);
+    }
+
+    // Whatever the arena could not hold is allocated one at a time, which tries the other arenas.
+    while(done < count && (out[done] = malloc_blk(size))) {done++;}
+    return done;
+}
+
+static int compare_ptrs(const void* a, const void* b) {
+    uintptr_t x = (uintptr_t) *(void* const*) a, y = (uintptr_t) *(void* const*) b;
+    return (x > y) - (x < y);
+}
+
+// Frees count pointers returned by malloc_blk, sorted by address. Heap blocks that follow each other in memory are freed
+// together with heap_free_run, and the others with free_blk. If a pointer is invalid or repeated, the program is aborted.
+static void free_batch_blk(void** ptrs, int count) {
+    int i = 0;
+    while(i < count) {
+        void* pp = ptrs[i];
+        if(i > 0 && pp == ptrs[i - 1]) {abort();}
+
+        // Find the run of heap blocks that starts with this one.
+        int run = 1;
+        if(!slab_owns(pp) && !large_owns(pp) && validate_block(pp) == 0) {
+            void* next_pp = pp + (load_blk_header((sf_block*) (pp - 16)) & 0x00000000FFFFFFF0);
+            while(i + run < count && ptrs[i + run] == next_pp && validate_block(next_pp) == 0) {
+                next_pp += load_blk_header((sf_block*) (next_pp - 16)) & 0x00000000FFFFFFF0;
+                run++;
+            }
         }
-        else if(curr_payload_size != 0 && alloc == 1) {
-            payload = payload + curr_payload_size;
-            blk_size = blk_size + curr_blk_size;
+        if(run == 1) {
+            free_blk(pp);
+            i++;
+            continue;
         }
 
-        void* next_blk_start = ((void*) curr_blk) + get_blk_size(curr_blk);
-        curr_blk = (sf_block*) next_blk_start;
+        for(int j = i; j < i + run; j++) {
+            trace(TRACE_FREE, ptrs[j], load_blk_header((sf_block*) (ptrs[j] - 16)) & 0x00000000FFFFFFF0);
+        }
+
+        // A block of another thread's arena would be queued alone, so its arena is locked instead.
+        struct sf_arena* arena = arena_of(pp - 16);
+        arena_lock(arena);
+        heap_free_run((sf_block*) (pp - 16), run);
+        arena_unlock(arena);
+        i += run;
+    }
+}
+
+// Resizes memory returned by malloc_blk. If the pointer is invalid, the program is aborted.
+static void* realloc_blk(void *pp, sf_size_t rsize) {
+    // Free block is request size is 0.
+    if(rsize == 0) {
+        sf_free(pp);
+        return NULL;
+    }
+
+    if(slab_owns(pp)) {return slab_realloc(pp, rsize);}
+    if(large_owns(pp)) {return large_realloc(pp, rsize);}
+
+    // Check if pointer and block are valid for reallocation.
+    if(validate_block(pp) == -1) {abort();}
+
+    // A heap block that grows past the mmap threshold moves to a mapping of its own.
+    void* large_ptr = large_malloc(rsize);
+    if(large_ptr) {
+        memcpy(large_ptr, pp, realloc_copy_size((sf_block*) (pp - 16), rsize));
+        sf_free(pp);
+        return large_ptr;
     }
 
-    if(blk_size == 0.0) {return 0.0;}
+    struct sf_arena* arena = arena_of(pp - 16);
+    arena_lock(arena);
+    void* ptr = heap_realloc(pp, rsize);
+    arena_unlock(arena);
 
-    return payload/blk_size;
+    return ptr;
 }
 
-double sf_peak_utilization() {
-    double agg_payload = 0.0;
-    double current_heap_size = sf_mem_end() - sf_mem_start();
-    if(current_heap_size == 0) {return 0.0;}
+// Returns a pointer to allocated memory for the requested size. If the size is invalid, or there is not enough memory to satisfy the request, return NULL;
+void *sf_malloc(sf_size_t size) {
+    if(size <= 0) return NULL;
+    stats_tick();
+
+    void* ptr = malloc_blk(size);
+
+    trace(TRACE_MALLOC, size, ptr);
+    if(record_active()) {record_malloc(size, ptr);}
+    return ptr;
+}
+
+// Returns a pointer to allocated memory for the requested size whose address is a multiple of align. If the alignment is
+// not a power of two, set sf_errno to EINVAL and return NULL. Otherwise behaves as sf_malloc.
+void *sf_memalign(sf_size_t align, sf_size_t size) {
+    if(!align || (align & (align - 1))) {
+        sf_errno = EINVAL;
+        return NULL;
+    }
+    if(size <= 0) return NULL;
+    stats_tick();
+
+    void* ptr = memalign_blk(size, align);
+
+    trace(TRACE_MALLOC, size, ptr);
+    if(record_active()) {record_malloc(size, ptr);}
+    return ptr;
+}
+
+void *sf_aligned_alloc(sf_size_t align, sf_size_t size) {
+    return sf_memalign(align, size);
+}
+
+// Returns a pointer to zeroed memory for count elements of size bytes. If the total does not fit in sf_size_t, set
+// sf_errno to ENOMEM and return NULL. Otherwise behaves as sf_malloc.
+void *sf_calloc(sf_size_t count, sf_size_t size) {
+    sf_size_t total;
+    if(__builtin_mul_overflow(count, size, &total)) {
+        sf_errno = ENOMEM;
+        return NULL;
+    }
+    if(total <= 0) return NULL;
+    stats_tick();
+
+    void* ptr = calloc_blk(total);
+
+    trace(TRACE_MALLOC, total, ptr);
+    if(record_active()) {record_malloc(total, ptr);}
+    return ptr;
+}
+
+// Allocates count blocks for requests of size and stores them in out. Returns the number allocated, which is less than
+// count only if there is not enough memory.
+int sf_malloc_batch(sf_size_t size, int count, void **out) {
+    if(size <= 0 || count <= 0) return 0;
+    stats_tick();
+
+    int done = malloc_batch_blk(size, count, out);
+
+    for(int i = 0; i < done; i++) {
+        trace(TRACE_MALLOC, size, out[i]);
+        if(record_active()) {record_malloc(size, out[i]);}
+    }
+    return done;
+}
+
+// Frees count allocated blocks, sorting ptrs by address. If a pointer is invalid or repeated, the program is aborted.
+void sf_free_batch(void **ptrs, int count) {
+    if(count <= 0) return;
+    stats_tick();
 
-    struct sf_block* curr_blk = (sf_block*) sf_mem_start();
+    if(record_active()) {
+        for(int i = 0; i < count; i++) {record_free(ptrs[i]);}
+    }
+    qsort(ptrs, count, sizeof(*ptrs), compare_ptrs);
+    free_batch_blk(ptrs, count);
+}
+
+// Frees allocated memory for the given block. If the pointer is invalid, the program is aborted.
+void sf_free(void *pp) {
+    stats_tick();
+
+    // The free is recorded first, as the address may be handed out again as soon as it is freed.
+    if(record_active()) {record_free(pp);}
+    free_blk(pp);
+}
+
+// Frees allocated memory for a block whose request, or last resize, was for size bytes. If the pointer is invalid, or in a
+// hardened build the size does not match, the program is aborted.
+void sf_free_sized(void *pp, sf_size_t size) {
+    stats_tick();
+
+    if(record_active()) {record_free(pp);}
+    free_sized_blk(pp, size);
+}
+
+void *sf_realloc(void *pp, sf_size_t rsize) {
+    if(!record_active()) {return realloc_blk(pp, rsize);}
+
+    // The mallocs and frees the resize makes are part of this event.
+    uint32_t id = record_realloc_begin(pp);
+    record_paused++;
+    void* ptr = realloc_blk(pp, rsize);
+    record_paused--;
+    record_realloc_end(id, pp, rsize, ptr);
+
+    return ptr;
+}
+
+// Totals over arena heaps.
+struct heap_usage {
+    double payload;         // Payload of allocated blocks.
+    double payload_blks;    // Size of allocated blocks.
+    double peak_payload;    // Highest payload seen.
+    size_t heap_size;
+    size_t free_size;       // Size of free blocks and blocks in quick lists. Only filled in by arena_free_usage.
+};
+
+// Adds an arena's payload counters and heap size to usage. This takes constant time.
+static void arena_usage(struct sf_arena* arena, struct heap_usage* usage) {
+    arena_lock(arena);
+    usage->payload += arena->payload;
+    usage->payload_blks += arena->payload_blk_size;
+    usage->peak_payload += arena->peak_payload;
+    usage->heap_size += arena_mem_end(arena) - arena_mem_start(arena);
+    arena_unlock(arena);
+}
+
+// Walks an arena's heap and adds its free blocks and quick list blocks to usage.
+static void arena_free_usage(struct sf_arena* arena, struct heap_usage* usage) {
+    arena_lock(arena);
+    if(arena_mem_start(arena) == arena_mem_end(arena)) {
+        arena_unlock(arena);
+        return;
+    }
+
+    struct sf_block* curr_blk = (sf_block*) arena_mem_start(arena);
     while(1) {
         uint64_t curr_blk_size = get_blk_size(curr_blk);
-        uint64_t curr_payload_size = get_payload_size(curr_blk);
         int alloc = (get_info_bits(curr_blk) < 4) ? 0 : 1;
-        if(curr_blk_size == 0 && curr_payload_size == 0 && alloc == 1) {
+        if(curr_blk_size == 0 && alloc == 1) {
             break;
         }
-        else if(alloc == 1) {
-            agg_payload = agg_payload + curr_payload_size;
+        else if(alloc == 0 || (get_info_bits(curr_blk) & 1)) {
+            usage->free_size += curr_blk_size;
         }
 
         void* next_blk_start = ((void*) curr_blk) + get_blk_size(curr_blk);
         curr_blk = (sf_block*) next_blk_start;
     }
+    arena_unlock(arena);
+}
+
+double sf_internal_fragmentation() {
+    struct heap_usage usage = {0};
+    for(int i = 0; i < SF_ARENAS; i++) {
+        arena_usage(&arenas[i], &usage);
+    }
+
+    if(usage.payload_blks == 0.0) {return 0.0;}
+
+    return usage.payload/usage.payload_blks;
+}
+
+// In a threaded build, the arenas' peaks are summed, which bounds the peak of their total from above.
+double sf_peak_utilization() {
+    struct heap_usage usage = {0};
+    for(int i = 0; i < SF_ARENAS; i++) {
+        arena_usage(&arenas[i], &usage);
+    }
+
+    if(usage.heap_size == 0) {return 0.0;}
+
+    return usage.peak_payload/usage.heap_size;
+}
+
+// Replaces the placement policy. A best-fit candidate count below 1 is treated as 1.
+void sf_set_placement_policy(const struct sf_placement_policy *policy) {
+    arena_lock_all();
+    placement_policy = *policy;
+    if(placement_policy.best_fit_candidates < 1) {placement_policy.best_fit_candidates = 1;}
+    arena_unlock_all();
+}
+
+// Copies the current placement policy into policy.
+void sf_get_placement_policy(struct sf_placement_policy *policy) {
+    arena_lock_all();
+    *policy = placement_policy;
+    arena_unlock_all();
+}
+
+// Sets the geometric growth factor used by grow_heap.
+void sf_set_growth_factor(double factor) {
+    arena_lock_all();
+    growth_factor = (factor < 1.0) ? 1.0 : factor;
+    arena_unlock_all();
+}
+
+// Sets the request size above which blocks are mapped directly. 0 disables direct mapping.
+void sf_set_mmap_threshold(size_t threshold) {
+    __atomic_store_n(&large_threshold, threshold, __ATOMIC_RELAXED);
+}
+
+// Sets the pending free count that triggers a coalescing sweep. Disabling deferred coalescing merges all pending blocks.
+void sf_set_coalesce_threshold(int threshold) {
+    arena_lock_all();
+    coalesce_threshold = (threshold < 0) ? 0 : threshold;
+    for(int i = 0; i < SF_ARENAS; i++) {
+        cur_arena = &arenas[i];
+        if(arena_mem_start(cur_arena) != arena_mem_end(cur_arena) && (!coalesce_threshold || cur_arena->pending_frees >= coalesce_threshold)) {
+            coalesce_heap();
+        }
+    }
+    arena_unlock_all();
+}
+
+// Replaces the quick list configuration, clamping its values, then applies it to every arena.
+void sf_set_quick_list_config(const struct sf_quick_list_config *config) {
+    struct sf_quick_list_config new_config = *config;
+    if(new_config.lists < 0) {new_config.lists = 0;}
+    if(new_config.lists > NUM_QUICK_LISTS) {new_config.lists = NUM_QUICK_LISTS;}
+    if(new_config.min_capacity < 1) {new_config.min_capacity = 1;}
+    if(new_config.max_capacity < new_config.min_capacity) {new_config.max_capacity = new_config.min_capacity;}
+    if(new_config.flush_percent < 1) {new_config.flush_percent = 1;}
+    if(new_config.flush_percent > 100) {new_config.flush_percent = 100;}
+
+    arena_lock_all();
+    quick_list_config = new_config;
+    for(int i = 0; i < SF_ARENAS; i++) {
+        cur_arena = &arenas[i];
+        if(arena_mem_start(cur_arena) != arena_mem_end(cur_arena)) {apply_quick_list_config();}
+    }
+    arena_unlock_all();
+}
+
+// Copies the current quick list configuration into config.
+void sf_get_quick_list_config(struct sf_quick_list_config *config) {
+    arena_lock_all();
+    *config = quick_list_config;
+    arena_unlock_all();
+}
+
+int sf_arena_count() {
+    return SF_ARENAS;
+}
+
+// Limits the arenas threads are assigned to. Counts outside 1 to SF_ARENAS are clamped.
+void sf_set_arena_count(int count) {
+    if(count < 1) {count = 1;}
+    if(count > SF_ARENAS) {count = SF_ARENAS;}
+    __atomic_store_n(&arena_limit, count, __ATOMIC_RELAXED);
+}
+
+// Copies the statistics of an arena into stats. Returns -1 if there is no arena with the given index.
+int sf_get_arena_stats(int index, struct sf_arena_stats *stats) {
+    if(index < 0 || index >= SF_ARENAS) {return -1;}
+
+    struct sf_arena* arena = &arenas[index];
+    struct heap_usage usage = {0};
+    arena_usage(arena, &usage);
+    arena_free_usage(arena, &usage);
+    stats->heap_size = usage.heap_size;
+    stats->free_size = usage.free_size;
+
+#ifdef SF_THREADS
+    stats->threads = __atomic_load_n(&arena->threads, __ATOMIC_RELAXED);
+    stats->lock_acquisitions = __atomic_load_n(&arena->lock_acquisitions, __ATOMIC_RELAXED);
+    stats->lock_contentions = __atomic_load_n(&arena->lock_contentions, __ATOMIC_RELAXED);
+    stats->remote_frees = __atomic_load_n(&arena->remote_free_count, __ATOMIC_RELAXED);
+#else
+    stats->threads = 1;
+    stats->lock_acquisitions = 0;
+    stats->lock_contentions = 0;
+    stats->remote_frees = 0;
+#endif
+
+    return 0;
+}
 
-    return agg_payload/current_heap_size;
+void sf_get_slab_stats(struct sf_slab_stats *stats) {
+    slab_stats(&stats->slabs, &stats->slots);
+#ifdef SF_SLAB
+    stats->bytes = stats->slabs * SLAB_SIZE;
+#else
+    stats->bytes = 0;
+#endif
 }
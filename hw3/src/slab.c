@@ -0,0 +1,216 @@
+#ifdef SF_SLAB
+#define _DEFAULT_SOURCE
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include "sfmm.h"
+#include "slab.h"
+
+#ifdef SF_THREADS
+#include <pthread.h>
+
+static pthread_mutex_t slab_mutex = PTHREAD_MUTEX_INITIALIZER;
+#define slab_lock() pthread_mutex_lock(&slab_mutex)
+#define slab_unlock() pthread_mutex_unlock(&slab_mutex)
+#else
+#define slab_lock()
+#define slab_unlock()
+#endif
+
+// Identifies a page as a live slab. It is XORed with the slab's address, so a stale copy elsewhere does not match.
+#define SLAB_MAGIC 0x51AB51AB51AB51ABull
+
+#define SLAB_BITMAP_WORDS 4  // Enough for the (SLAB_SIZE - header) / 16 slots of the smallest class.
+
+// Header at the start of every slab. The slots follow it.
+struct slab {
+    uint64_t magic;
+    struct slab* next;          // Links in the class's list of slabs with free slots, or in the pool of empty slabs.
+    struct slab* prev;
+    uint16_t slot_size;
+    uint16_t slots;
+    uint16_t used;
+    uint64_t bitmap[SLAB_BITMAP_WORDS];  // Bit i is set if slot i is allocated.
+};
+
+// Offset of the first slot, rounded up so that slots are 16-byte aligned.
+#define SLAB_HDR_SIZE ((sizeof(struct slab) + 15) & ~(size_t) 15)
+
+// Slabs with free slots, per class, and empty slabs that no class holds.
+static struct slab* partial_slabs[SLAB_CLASSES];
+static struct slab* empty_slabs;
+
+// The reservation slabs are carved from. Slabs below slab_next have been handed out at least once.
+static char* slab_base;
+static char* slab_next;
+static int slab_failed;
+
+// Given a slab, remove it from the list starting at head.
+static void slab_unlink(struct slab** head, struct slab* slab) {
+    if(slab->prev) {slab->prev->next = slab->next;}
+    else {*head = slab->next;}
+    if(slab->next) {slab->next->prev = slab->prev;}
+    slab->next = slab->prev = NULL;
+}
+
+// Given a slab, add it to the front of the list starting at head.
+static void slab_push(struct slab** head, struct slab* slab) {
+    slab->prev = NULL;
+    slab->next = *head;
+    if(*head) {(*head)->prev = slab;}
+    *head = slab;
+}
+
+// Return an empty slab set up for the given class, or NULL if the reservation is used up.
+static struct slab* slab_create(int cls) {
+    struct slab* slab = empty_slabs;
+    if(slab) {
+        slab_unlink(&empty_slabs, slab);
+    }
+    else {
+        if(!slab_base && !slab_failed) {
+            void* region = mmap(NULL, SF_SLAB_REGION, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+            if(region == MAP_FAILED) {
+                slab_failed = 1;
+                return NULL;
+            }
+            slab_next = (char*) region;
+            __atomic_store_n(&slab_base, (char*) region, __ATOMIC_RELEASE);
+        }
+        if(!slab_base || slab_next == slab_base + SF_SLAB_REGION) {return NULL;}
+
+        slab = (struct slab*) slab_next;
+        slab_next += SLAB_SIZE;
+    }
+
+    memset(slab, 0, SLAB_HDR_SIZE);
+    slab->magic = SLAB_MAGIC ^ (uint64_t) slab;
+    slab->slot_size = (cls + 1) * 16;
+    slab->slots = (SLAB_SIZE - SLAB_HDR_SIZE) / slab->slot_size;
+    return slab;
+}
+
+// Returns nonzero if the given address lies in the slab reservation.
+int slab_owns(void* ptr) {
+    char* base = __atomic_load_n(&slab_base, __ATOMIC_ACQUIRE);
+    return base && (char*) ptr >= base && (char*) ptr < base + SF_SLAB_REGION;
+}
+
+// Given a request size, return a free slot of its class. Returns NULL if the request is over SLAB_MAX_SIZE bytes or no slab can be had.
+void* slab_malloc(sf_size_t size) {
+    if(size > SLAB_MAX_SIZE) {return NULL;}
+    int cls = (size - 1) / 16;
+
+    slab_lock();
+    struct slab* slab = partial_slabs[cls];
+    if(!slab) {
+        slab = slab_create(cls);
+        if(!slab) {
+            slab_unlock();
+            return NULL;
+        }
+        slab_push(&partial_slabs[cls], slab);
+    }
+
+    // Take the lowest free slot.
+    int word = 0;
+    while(!~slab->bitmap[word]) {word++;}
+    int bit = __builtin_ctzll(~slab->bitmap[word]);
+    slab->bitmap[word] |= (1ull << bit);
+
+    // A full slab leaves the partial list until one of its slots is freed.
+    if(++slab->used == slab->slots) {slab_unlink(&partial_slabs[cls], slab);}
+    slab_unlock();
+
+    return ((char*) slab) + SLAB_HDR_SIZE + (size_t) (word * 64 + bit) * slab->slot_size;
+}
+
+// Given the address of a slot, return its slab and index. Returns NULL if the address is not an allocated slot.
+static struct slab* slab_slot(void* ptr, int* slot) {
+    struct slab* slab = (struct slab*) ((uintptr_t) ptr & ~(uintptr_t) (SLAB_SIZE - 1));
+    if(slab->magic != (SLAB_MAGIC ^ (uint64_t) slab)) {return NULL;}
+
+    uintptr_t offset = (uintptr_t) ptr - (uintptr_t) slab;
+    if(offset < SLAB_HDR_SIZE || (offset - SLAB_HDR_SIZE) % slab->slot_size != 0) {return NULL;}
+    *slot = (offset - SLAB_HDR_SIZE) / slab->slot_size;
+    if(*slot >= slab->slots || !(slab->bitmap[*slot / 64] & (1ull << (*slot % 64)))) {return NULL;}
+
+    return slab;
+}
+
+// Given an address in the slab reservation, free its slot. Returns -1 if it is not an allocated slot.
+int slab_free(void* ptr) {
+    int slot;
+
+    slab_lock();
+    struct slab* slab = slab_slot(ptr, &slot);
+    if(!slab) {
+        slab_unlock();
+        return -1;
+    }
+
+    int cls = slab->slot_size / 16 - 1;
+    slab->bitmap[slot / 64] &= ~(1ull << (slot % 64));
+
+    // A full slab has free slots again. An empty one is given up, unless the class has no other partial slab.
+    if(slab->used-- == slab->slots) {
+        slab_push(&partial_slabs[cls], slab);
+    }
+    if(!slab->used && (slab->prev || slab->next)) {
+        slab_unlink(&partial_slabs[cls], slab);
+        slab->magic = 0;
+        slab_push(&empty_slabs, slab);
+    }
+    slab_unlock();
+
+    return 0;
+}
+
+// Given an address in the slab reservation, resize its allocation. Aborts if it is not an allocated slot.
+// A request that still fits the slot keeps it. Otherwise the contents move to a new allocation.
+void* slab_realloc(void* ptr, sf_size_t rsize) {
+    int slot;
+
+    slab_lock();
+    struct slab* slab = slab_slot(ptr, &slot);
+    sf_size_t slot_size = slab ? slab->slot_size : 0;
+    slab_unlock();
+    if(!slab) {abort();}
+
+    if(rsize <= slot_size) {return ptr;}
+
+    void* new_ptr = sf_malloc(rsize);
+    if(!new_ptr) {return NULL;}
+    memcpy(new_ptr, ptr, slot_size);
+    slab_free(ptr);
+
+    return new_ptr;
+}
+
+// Given an address in the slab reservation, return the size of its slot, or 0 if it is not an allocated slot.
+sf_size_t slab_usable_size(void* ptr) {
+    int slot;
+
+    slab_lock();
+    struct slab* slab = slab_slot(ptr, &slot);
+    sf_size_t slot_size = slab ? slab->slot_size : 0;
+    slab_unlock();
+
+    return slot_size;
+}
+
+// Count the slabs in use and the slots allocated in them.
+void slab_stats(size_t* slabs, size_t* slots) {
+    *slabs = *slots = 0;
+
+    slab_lock();
+    for(char* page = slab_base; page && page < slab_next; page += SLAB_SIZE) {
+        struct slab* slab = (struct slab*) page;
+        if(slab->magic == (SLAB_MAGIC ^ (uint64_t) slab)) {
+            (*slabs)++;
+            *slots += slab->used;
+        }
+    }
+    slab_unlock();
+}
+#endif
@@ -0,0 +1,140 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdint.h>
+#include <string.h>
+#include <limits.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "helper.h"
+#include "arena.h"
+#include "stats.h"
+#include "timing.h"
+
+// File the statistics are exported to, and the export interval in ns. An interval of 0 means no export.
+static char export_path[PATH_MAX];
+static uint64_t export_interval;
+static uint64_t next_export;
+
+// Allocator calls since the time was last checked.
+static ARENA_LOCAL unsigned tick_count;
+
+// Adds an arena's statistics to stats. The arena's free lists are walked.
+static void arena_stats(struct sf_arena* arena, struct sf_stats* stats) {
+    arena_lock(arena);
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        stats->quick_lists[i].hits += arena->quick_list_hit_count[i];
+        stats->quick_lists[i].misses += arena->quick_list_miss_count[i];
+        stats->quick_lists[i].flushes += arena->quick_list_flush_count[i];
+        stats->quick_lists[i].length += arena->quick_lists[i].length;
+    }
+
+    // The lists are only set up once the arena's heap is.
+    if(arena_mem_start(arena) != arena_mem_end(arena)) {
+        for(int i = 0; i < NUM_FREE_LISTS; i++) {
+            struct sf_block* head = &arena->free_list_heads[i];
+            for(struct sf_block* blk = head->body.links.next; blk != head; blk = blk->body.links.next) {
+                stats->free_lists[i].length++;
+                stats->free_lists[i].bytes += get_blk_size(blk);
+            }
+        }
+    }
+
+    stats->splits += arena->splits;
+    stats->coalesces += arena->coalesces;
+    stats->grows += arena->grows;
+    stats->requested_bytes += arena->payload;
+    stats->in_use_bytes += arena->payload_blk_size;
+    stats->heap_bytes += arena_mem_end(arena) - arena_mem_start(arena);
+    arena_unlock(arena);
+}
+
+void sf_get_stats(struct sf_stats *stats) {
+    memset(stats, 0, sizeof(*stats));
+    for(int i = 0; i < SF_ARENAS; i++) {
+        arena_stats(&arenas[i], stats);
+    }
+}
+
+// Writes the HELP and TYPE lines that introduce a metric.
+static void write_metric_info(FILE* out, const char* name, const char* type, const char* help) {
+    fprintf(out, "# HELP %s %s\n# TYPE %s %s\n", name, help, name, type);
+}
+
+int sf_write_stats(const char *path) {
+    struct sf_stats stats;
+    sf_get_stats(&stats);
+
+    char tmp_path[PATH_MAX];
+    if(snprintf(tmp_path, sizeof(tmp_path), "%s.tmp", path) >= sizeof(tmp_path)) {return -1;}
+    FILE* out = fopen(tmp_path, "w");
+    if(!out) {return -1;}
+
+    // Quick lists are labelled with their block size, free lists with their index.
+    write_metric_info(out, "sf_quick_list_hits_total", "counter", "Requests served from a quick list.");
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        fprintf(out, "sf_quick_list_hits_total{size=\"%d\"} %lu\n", 32 + 16 * i, (unsigned long) stats.quick_lists[i].hits);
+    }
+    write_metric_info(out, "sf_quick_list_misses_total", "counter", "Requests of a quick list's size that found it empty.");
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        fprintf(out, "sf_quick_list_misses_total{size=\"%d\"} %lu\n", 32 + 16 * i, (unsigned long) stats.quick_lists[i].misses);
+    }
+    write_metric_info(out, "sf_quick_list_flushes_total", "counter", "Frees that found a quick list full.");
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        fprintf(out, "sf_quick_list_flushes_total{size=\"%d\"} %lu\n", 32 + 16 * i, (unsigned long) stats.quick_lists[i].flushes);
+    }
+    write_metric_info(out, "sf_quick_list_blocks", "gauge", "Blocks in a quick list.");
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        fprintf(out, "sf_quick_list_blocks{size=\"%d\"} %d\n", 32 + 16 * i, stats.quick_lists[i].length);
+    }
+    write_metric_info(out, "sf_free_list_blocks", "gauge", "Blocks in a free list.");
+    for(int i = 0; i < NUM_FREE_LISTS; i++) {
+        fprintf(out, "sf_free_list_blocks{list=\"%d\"} %zu\n", i, stats.free_lists[i].length);
+    }
+    write_metric_info(out, "sf_free_list_bytes", "gauge", "Total size of the blocks in a free list.");
+    for(int i = 0; i < NUM_FREE_LISTS; i++) {
+        fprintf(out, "sf_free_list_bytes{list=\"%d\"} %zu\n", i, stats.free_lists[i].bytes);
+    }
+
+    write_metric_info(out, "sf_splits_total", "counter", "Blocks split in two.");
+    fprintf(out, "sf_splits_total %lu\n", (unsigned long) stats.splits);
+    write_metric_info(out, "sf_coalesces_total", "counter", "Pairs of free blocks merged.");
+    fprintf(out, "sf_coalesces_total %lu\n", (unsigned long) stats.coalesces);
+    write_metric_info(out, "sf_heap_grows_total", "counter", "Times the heap was extended.");
+    fprintf(out, "sf_heap_grows_total %lu\n", (unsigned long) stats.grows);
+    write_metric_info(out, "sf_requested_bytes", "gauge", "Payload of allocated blocks, as requested.");
+    fprintf(out, "sf_requested_bytes %zu\n", stats.requested_bytes);
+    write_metric_info(out, "sf_in_use_bytes", "gauge", "Size of allocated blocks.");
+    fprintf(out, "sf_in_use_bytes %zu\n", stats.in_use_bytes);
+    write_metric_info(out, "sf_heap_bytes", "gauge", "Size of the heap.");
+    fprintf(out, "sf_heap_bytes %zu\n", stats.heap_bytes);
+
+    if(fclose(out) != 0 || rename(tmp_path, path) != 0) {
+        remove(tmp_path);
+        return -1;
+    }
+    return 0;
+}
+
+// Stops any export in progress, then starts the new one. The first file is written at the first check.
+void sf_set_stats_export(const char *path, unsigned interval_ms) {
+    __atomic_store_n(&export_interval, 0, __ATOMIC_RELEASE);
+    if(!path || !interval_ms || strlen(path) + 1 > sizeof(export_path)) {return;}
+
+    strcpy(export_path, path);
+    __atomic_store_n(&next_export, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&export_interval, (uint64_t) interval_ms * 1000000, __ATOMIC_RELEASE);
+}
+
+void stats_tick() {
+    uint64_t interval = __atomic_load_n(&export_interval, __ATOMIC_ACQUIRE);
+    if(!interval || ++tick_count < STATS_TICK_CHECK) {return;}
+    tick_count = 0;
+
+    // Whichever thread moves the deadline forward writes the file.
+    uint64_t now = now_ns();
+    uint64_t next = __atomic_load_n(&next_export, __ATOMIC_RELAXED);
+    if(now < next || !__atomic_compare_exchange_n(&next_export, &next, now + interval, 0, __ATOMIC_RELAXED, __ATOMIC_RELAXED)) {
+        return;
+    }
+    sf_write_stats(export_path);
+}
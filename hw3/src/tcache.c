@@ -0,0 +1,156 @@
+#ifdef SF_THREADS
+#include <pthread.h>
+#include "sfmm.h"
+#include "helper.h"
+#include "arena.h"
+#include "tcache.h"
+
+// Upper bounds on the length of each cache list and on the bytes held by a cache, and the number of blocks moved per refill or drain.
+#ifndef SF_TCACHE_MAX
+#define SF_TCACHE_MAX 16
+#endif
+#ifndef SF_TCACHE_BYTES
+#define SF_TCACHE_BYTES 1024
+#endif
+#ifndef SF_TCACHE_BATCH
+#define SF_TCACHE_BATCH 8
+#endif
+
+// A thread's cache. List i holds blocks of the size of quick list i, linked through body.links.next.
+struct tcache {
+    sf_block* first[NUM_QUICK_LISTS];
+    int length[NUM_QUICK_LISTS];
+    uint32_t bytes;
+    int registered;
+};
+
+static __thread struct tcache tcache;
+
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+static pthread_key_t tcache_key;
+
+// Return up to count blocks from the head of the given cache list to the arenas they belong to. No arena may be locked.
+static void tcache_drain(struct tcache* cache, int index, int count) {
+    struct sf_arena* locked = NULL;
+
+    while(count > 0 && cache->first[index]) {
+        struct sf_block* blk = cache->first[index];
+        cache->first[index] = blk->body.links.next;
+        cache->length[index]--;
+        cache->bytes -= get_blk_size(blk);
+        count--;
+
+        // Blocks of other threads' arenas are queued for them. Blocks of the thread's own arena are freed under one lock.
+        struct sf_arena* arena = arena_of(blk);
+        if(arena_is_remote(arena)) {
+            arena_remote_free(arena, blk);
+            continue;
+        }
+        if(!locked) {
+            arena_lock(arena);
+            locked = arena;
+        }
+        heap_free(blk);
+    }
+
+    if(locked) {arena_unlock(locked);}
+}
+
+// Key destructor, run when a thread exits. Return all of the thread's cached blocks to their arenas.
+static void tcache_destroy(void* arg) {
+    struct tcache* cache = (struct tcache*) arg;
+
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        tcache_drain(cache, i, cache->length[i]);
+    }
+}
+
+static void tcache_create_key() {
+    pthread_key_create(&tcache_key, tcache_destroy);
+}
+
+// Register the calling thread's cache so that it is drained when the thread exits.
+static void tcache_register() {
+    pthread_once(&tcache_key_once, tcache_create_key);
+    pthread_setspecific(tcache_key, &tcache);
+    tcache.registered = 1;
+}
+
+// Move up to SF_TCACHE_BATCH blocks of the given size from the current arena into the cache. The arena must be locked.
+static void tcache_refill(int index, uint32_t blk_size) {
+    for(int i = 0; i < SF_TCACHE_BATCH; i++) {
+        // Stop early if the cache would exceed its budget, but always take the block being requested.
+        if(i > 0 && tcache.bytes + blk_size > SF_TCACHE_BYTES) {break;}
+
+        // The payload of a cached block is recorded as the whole block, as the fast path does not update it.
+        void* payload = heap_malloc(blk_size, blk_size - 8);
+        if(!payload) {break;}
+
+        struct sf_block* blk = (sf_block*) (payload - 16);
+        blk->body.links.next = tcache.first[index];
+        tcache.first[index] = blk;
+        tcache.length[index]++;
+        tcache.bytes += blk_size;
+    }
+}
+
+// Return all of the calling thread's cached blocks to their arenas, so that they can be coalesced and reused.
+// Returns the number of blocks returned. No arena may be locked.
+int tcache_flush() {
+    int flushed = 0;
+    for(int i = 0; i < NUM_QUICK_LISTS; i++) {
+        flushed += tcache.length[i];
+        tcache_drain(&tcache, i, tcache.length[i]);
+    }
+    return flushed;
+}
+
+// Given the size of a requested block, return the payload of a block from the calling thread's cache, refilling it if empty.
+// If the size is not cached, or the thread's arena cannot refill the cache, return NULL.
+void* tcache_malloc(uint32_t blk_size) {
+    int index = get_quick_list_idx(blk_size);
+    if(index == -1) {return NULL;}
+
+    if(!tcache.first[index]) {
+        if(!tcache.registered) {tcache_register();}
+
+        struct sf_arena* arena = arena_get();
+        tcache_refill(index, blk_size);
+        arena_unlock(arena);
+
+        if(!tcache.first[index]) {return NULL;}
+    }
+
+    struct sf_block* blk = tcache.first[index];
+    tcache.first[index] = blk->body.links.next;
+    tcache.length[index]--;
+    tcache.bytes -= blk_size;
+
+    return &(blk->body.payload);
+}
+
+// Given a valid allocated block, put it in the calling thread's cache, draining a batch if the list overflows.
+// If the size is not cached, return 0 and leave the block to its arena.
+int tcache_free(sf_block* blk) {
+    return tcache_free_sized(blk, load_blk_header(blk) & 0x00000000FFFFFFF0);
+}
+
+// Like tcache_free, for a block whose size the caller has already decoded.
+int tcache_free_sized(sf_block* blk, uint32_t blk_size) {
+    int index = get_quick_list_idx(blk_size);
+    if(index == -1) {return 0;}
+
+    if(!tcache.registered) {tcache_register();}
+
+    blk->body.links.next = tcache.first[index];
+    tcache.first[index] = blk;
+    tcache.length[index]++;
+    tcache.bytes += blk_size;
+
+    if(tcache.length[index] > SF_TCACHE_MAX || tcache.bytes > SF_TCACHE_BYTES) {
+        tcache_drain(&tcache, index, SF_TCACHE_BATCH);
+    }
+
+    return 1;
+}
+#endif
@@ -0,0 +1,107 @@
+#ifdef TLSF
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "helper.h"
+#include "tlsf.h"
+#include "arena.h"
+
+// Given the free list a block size belongs to, return the second-level range within that list.
+static int tlsf_sl_idx(int fl, uint32_t size) {
+    if(fl == 0) {return 0;}
+
+    // The last list is unbounded, so its ranges are successive powers of two above its lower bound.
+    if(fl == NUM_FREE_LISTS - 1) {
+        uint32_t lower = (uint32_t) 32 << (NUM_FREE_LISTS - 2);
+        int sl = 31 - __builtin_clz((size - 1) / lower);
+        return (sl < TLSF_SL_COUNT) ? sl : TLSF_SL_COUNT - 1;
+    }
+
+    // List fl covers (lower, 2 * lower], split into ranges of lower / TLSF_SL_COUNT bytes.
+    uint32_t lower = (uint32_t) 32 << (fl - 1);
+    return ((size - lower - 1) * TLSF_SL_COUNT) / lower;
+}
+
+// Initialize the second-level index. The free list sentinels are set up by init_free_lists.
+void tlsf_init() {
+    cur_arena->tlsf_fl_bitmap = 0;
+    for(int i = 0; i < NUM_FREE_LISTS; i++) {
+        cur_arena->tlsf_sl_bitmap[i] = 0;
+        for(int j = 0; j < TLSF_SL_COUNT; j++) {
+            cur_arena->tlsf_heads[i][j] = NULL;
+        }
+    }
+}
+
+// Given the size of a block, return a single number identifying its (list, range) pair.
+int tlsf_bucket(uint32_t size) {
+    int fl = get_free_list_idx(size);
+    return fl * TLSF_SL_COUNT + tlsf_sl_idx(fl, size);
+}
+
+// Adds a block to the front of its range.
+void tlsf_insert_blk(sf_block* blk, uint32_t size) {
+    int fl = get_free_list_idx(size);
+    int sl = tlsf_sl_idx(fl, size);
+
+    // If the range is empty, the block goes in front of the next non-empty range so the list stays ordered.
+    struct sf_block* succ = cur_arena->tlsf_heads[fl][sl];
+    if(!succ) {
+        uint32_t higher = cur_arena->tlsf_sl_bitmap[fl] & (~0u << (sl + 1));
+        succ = higher ? cur_arena->tlsf_heads[fl][__builtin_ctz(higher)] : &cur_arena->free_list_heads[fl];
+    }
+
+    struct sf_block* prev = succ->body.links.prev;
+    blk->body.links.prev = prev;
+    blk->body.links.next = succ;
+    prev->body.links.next = succ->body.links.prev = blk;
+
+    cur_arena->tlsf_heads[fl][sl] = blk;
+    cur_arena->tlsf_sl_bitmap[fl] |= (1u << sl);
+    cur_arena->tlsf_fl_bitmap |= (1u << fl);
+}
+
+// Removes a block from its range. The size must be the one the block was inserted with.
+void tlsf_remove_blk(sf_block* blk, uint32_t size) {
+    int fl = get_free_list_idx(size);
+    int sl = tlsf_sl_idx(fl, size);
+
+    // If the block starts its range, the next block in the list takes over unless it belongs to another range.
+    if(cur_arena->tlsf_heads[fl][sl] == blk) {
+        struct sf_block* next = blk->body.links.next;
+        if(next != &cur_arena->free_list_heads[fl] && tlsf_sl_idx(fl, get_blk_size(next)) == sl) {
+            cur_arena->tlsf_heads[fl][sl] = next;
+        }
+        else {
+            cur_arena->tlsf_heads[fl][sl] = NULL;
+            cur_arena->tlsf_sl_bitmap[fl] &= ~(1u << sl);
+            if(!cur_arena->tlsf_sl_bitmap[fl]) {cur_arena->tlsf_fl_bitmap &= ~(1u << fl);}
+        }
+    }
+
+    struct sf_block* prev_blk = blk->body.links.prev;
+    struct sf_block* next_blk = blk->body.links.next;
+    prev_blk->body.links.next = next_blk;
+    next_blk->body.links.prev = prev_blk;
+    blk->body.links.prev = blk->body.links.next = NULL;
+}
+
+// Given the size of a block, return a free block that can hold it, or NULL if there is none.
+sf_block* tlsf_find_fit(uint32_t blk_size) {
+    int fl = get_free_list_idx(blk_size);
+    int sl = tlsf_sl_idx(fl, blk_size);
+
+    // Blocks in the request's own range may be smaller than the request, so only its first block is tried.
+    struct sf_block* head = cur_arena->tlsf_heads[fl][sl];
+    if(head && get_blk_size(head) >= blk_size) {return head;}
+
+    // Every block in a higher range fits.
+    uint32_t sl_map = cur_arena->tlsf_sl_bitmap[fl] & (~0u << (sl + 1));
+    if(!sl_map) {
+        uint32_t fl_map = cur_arena->tlsf_fl_bitmap & (~0u << (fl + 1));
+        if(!fl_map) {return NULL;}
+        fl = __builtin_ctz(fl_map);
+        sl_map = cur_arena->tlsf_sl_bitmap[fl];
+    }
+    return cur_arena->tlsf_heads[fl][__builtin_ctz(sl_map)];
+}
+#endif
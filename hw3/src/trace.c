@@ -0,0 +1,46 @@
+#ifdef TRACE
+#include <stdio.h>
+#include <stdint.h>
+#include "debug.h"
+
+// A single recorded trace event.
+struct trace_entry {
+    uint64_t seq;
+    trace_event event;
+    uint64_t a;
+    uint64_t b;
+};
+
+// Threaded builds keep one ring per thread so that recording needs no lock.
+#ifdef SF_THREADS
+#define TRACE_LOCAL __thread
+#else
+#define TRACE_LOCAL
+#endif
+
+static TRACE_LOCAL struct trace_entry trace_ring[TRACE_RING_SIZE];
+static TRACE_LOCAL uint64_t trace_seq;
+
+static const char* trace_event_names[NUM_TRACE_EVENTS] = {
+    "malloc", "free", "split", "coalesce", "flush", "grow"
+};
+
+// Records an event, overwriting the oldest entry once the ring is full.
+void sf_trace_record(trace_event event, uint64_t a, uint64_t b) {
+    struct trace_entry* entry = &trace_ring[trace_seq & (TRACE_RING_SIZE - 1)];
+    entry->seq = trace_seq++;
+    entry->event = event;
+    entry->a = a;
+    entry->b = b;
+}
+
+// Prints the events currently held in the ring, oldest first.
+void sf_trace_dump(FILE *out) {
+    uint64_t first = (trace_seq > TRACE_RING_SIZE) ? trace_seq - TRACE_RING_SIZE : 0;
+    for(uint64_t seq = first; seq < trace_seq; seq++) {
+        struct trace_entry* entry = &trace_ring[seq & (TRACE_RING_SIZE - 1)];
+        fprintf(out, "%8lu %-8s 0x%-14lx 0x%lx\n", (unsigned long) entry->seq,
+                trace_event_names[entry->event], (unsigned long) entry->a, (unsigned long) entry->b);
+    }
+}
+#endif
@@ -0,0 +1,148 @@
+#ifdef SF_SLAB
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <signal.h>
+#include <string.h>
+#include <stdint.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "slab.h"
+#define TEST_TIMEOUT 15
+
+/*
+ * Tests of the slab allocator, built and run by make slab. The heap tests in sfmm_tests.c assume
+ * small requests get heap blocks, so they are not run in that build.
+ */
+
+// Returns the slab holding the given slot.
+static uintptr_t slab_of(void *ptr) {
+    return (uintptr_t) ptr & ~(uintptr_t) (SLAB_SIZE - 1);
+}
+
+/*
+ * Assert the number of slabs in use and of slots allocated in them.
+ */
+static void assert_slab_stats(size_t slabs, size_t slots) {
+    struct sf_slab_stats stats;
+    sf_get_slab_stats(&stats);
+    cr_assert_eq(stats.slabs, slabs, "Wrong number of slabs (exp=%zu, found=%zu)", slabs, stats.slabs);
+    cr_assert_eq(stats.slots, slots, "Wrong number of slots (exp=%zu, found=%zu)", slots, stats.slots);
+    cr_assert_eq(stats.bytes, slabs * SLAB_SIZE, "Wrong number of slab bytes (exp=%zu, found=%zu)",
+                 slabs * SLAB_SIZE, stats.bytes);
+}
+
+Test(sfmm_slab_suite, slab_stats_test, .timeout = TEST_TIMEOUT) {
+    assert_slab_stats(0, 0);
+
+    // One slab per class.
+    void *x = sf_malloc(1);
+    void *y = sf_malloc(16);
+    void *z = sf_malloc(100);
+    cr_assert(slab_of(x) == slab_of(y), "Requests of one class are in different slabs!");
+    cr_assert(slab_of(x) != slab_of(z), "Requests of different classes share a slab!");
+    cr_assert((uintptr_t) x % 16 == 0 && (uintptr_t) z % 16 == 0, "Slots are not aligned!");
+    assert_slab_stats(2, 3);
+
+    // Requests over SLAB_MAX_SIZE bytes go to the heap.
+    void *w = sf_malloc(SLAB_MAX_SIZE + 1);
+    cr_assert_not_null(w, "w is NULL!");
+    assert_slab_stats(2, 3);
+    cr_assert(w >= sf_mem_start() && w < sf_mem_end(), "Large request was not served by the heap!");
+}
+
+Test(sfmm_slab_suite, fill_and_empty_slab_test, .timeout = TEST_TIMEOUT) {
+    // Fill the first slab of a class, and take one slot of the next.
+    void *slots[SLAB_SIZE / 16];
+    int count = 0;
+    void *extra;
+    while(1) {
+        void *ptr = sf_malloc(16);
+        cr_assert_not_null(ptr, "Slot is NULL!");
+        if(count && slab_of(ptr) != slab_of(slots[0])) {
+            extra = ptr;
+            break;
+        }
+        memset(ptr, 0xff, 16);
+        slots[count++] = ptr;
+    }
+    cr_assert(count > 200, "A slab of 16-byte slots only held %d slots", count);
+    assert_slab_stats(2, count + 1);
+
+    // The second slab empties, and is kept as the only partial slab of its class.
+    sf_free(extra);
+    assert_slab_stats(2, count);
+
+    // The first slab empties too. As the class has another partial slab, it goes back to the pool.
+    for(int i = 0; i < count; i++) {
+        sf_free(slots[i]);
+    }
+    assert_slab_stats(1, 0);
+}
+
+Test(sfmm_slab_suite, reuse_empty_slab_test, .timeout = TEST_TIMEOUT) {
+    // Fill a slab of 32-byte slots, then empty it while a second slab of the class is in use.
+    void *x = sf_malloc(32);
+    void *slots[SLAB_SIZE / 32];
+    int count = 0;
+    slots[count++] = x;
+    void *extra;
+    while(1) {
+        void *ptr = sf_malloc(32);
+        if(slab_of(ptr) != slab_of(x)) {
+            extra = ptr;
+            break;
+        }
+        slots[count++] = ptr;
+    }
+    for(int i = 0; i < count; i++) {
+        sf_free(slots[i]);
+    }
+    assert_slab_stats(1, 1);
+
+    // The pooled slab is handed to the next class that needs one, instead of a new page.
+    void *z = sf_malloc(160);
+    cr_assert(slab_of(z) == slab_of(x), "Empty slab was not reused!");
+    assert_slab_stats(2, 2);
+    sf_free(extra);
+    sf_free(z);
+}
+
+Test(sfmm_slab_suite, free_invalid_slot_test, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+    char *x = sf_malloc(48);
+    sf_free(x + 16);
+}
+
+Test(sfmm_slab_suite, double_free_slot_test, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+    void *x = sf_malloc(48);
+    void *y = sf_malloc(48);
+    sf_free(x);
+    sf_free(x);
+    sf_free(y);
+}
+
+Test(sfmm_slab_suite, realloc_slot_test, .timeout = TEST_TIMEOUT) {
+    char *x = sf_malloc(40);
+    memset(x, 'a', 40);
+
+    // A request that fits the 48-byte slot keeps it.
+    char *y = sf_realloc(x, 48);
+    cr_assert(y == x, "Realloc within the slot moved it!");
+    memset(y, 'b', 48);
+    assert_slab_stats(1, 1);
+
+    // A larger one moves to the heap, and the slot is freed.
+    char *z = sf_realloc(y, 500);
+    cr_assert_not_null(z, "z is NULL!");
+    cr_assert((void *) z >= sf_mem_start() && (void *) z < sf_mem_end(), "Realloc did not move to the heap!");
+    for(int i = 0; i < 48; i++) {
+        cr_assert(z[i] == 'b', "Contents were lost at byte %d", i);
+    }
+    assert_slab_stats(1, 0);
+
+    // And the heap block back into a slot.
+    char *w = sf_realloc(z, 20);
+    cr_assert_not_null(w, "w is NULL!");
+    cr_assert(w == z, "Shrinking a heap block moved it!");
+    sf_free(w);
+}
+#endif
@@ -1,8 +1,14 @@
+#define _DEFAULT_SOURCE
 #include <criterion/criterion.h>
 #include <errno.h>
 #include <signal.h>
+#include <string.h>
+#include <unistd.h>
+#include <sys/mman.h>
 #include "debug.h"
 #include "sfmm.h"
+#include "sfmm_ext.h"
+#include "record.h"
 #define TEST_TIMEOUT 15
 
 /*
@@ -371,6 +377,526 @@ Test(sfmm_student_suite, frag_util_test, .timeout = TEST_TIMEOUT) {
     sf_free(c);
 
     cr_assert(sf_internal_fragmentation() == (1425.0/1472.0), "Internal fragmentation calculated incorrectly.");
-    cr_assert(sf_peak_utilization() == (1425.0/2048.0), "Peak utilization calculated incorrectly.");
+    cr_assert(sf_peak_utilization() == (1905.0/2048.0), "Peak utilization calculated incorrectly.");
 }
 
+
+// Testing if malloc skips a size class holding only blocks that are too small.
+Test(sfmm_student_suite, freelist_skip_small_class_test, .timeout = TEST_TIMEOUT) {
+    size_t sz_small = 184, sz_large = 300, sz_req = 248;
+    void *x = sf_malloc(sz_small);
+    /* void *g1 = */ sf_malloc(sz_small);
+    void *y = sf_malloc(sz_large);
+    /* void *g2 = */ sf_malloc(sz_small);
+
+    sf_free(x);
+    sf_free(y);
+
+    // Free list (128, 256] now holds only a block of 192, which does not fit a 256 byte block.
+    void *z = sf_malloc(sz_req);
+    cr_assert(z == y, "Request was not placed in the first block that fits (got %p, exp %p)", z, y);
+    cr_assert(sf_mem_start() + PAGE_SZ == sf_mem_end(), "Heap was extended although a block fit!");
+
+    assert_quick_list_block_count(0, 0);
+    assert_free_block_count(192, 1);
+    assert_free_block_count(80, 1);
+    assert_free_block_count(64, 1);
+}
+
+// Testing if the block added to a quick list right after a flush ends the list.
+Test(sfmm_student_suite, quick_list_after_flush_test, .timeout = TEST_TIMEOUT) {
+    size_t sz = 50;
+    void *blks[QUICK_LIST_MAX + 1];
+    for(int i = 0; i < QUICK_LIST_MAX + 1; i++) {
+        blks[i] = sf_malloc(sz);
+        memset(blks[i], 0xff, sz);
+    }
+    for(int i = 0; i < QUICK_LIST_MAX + 1; i++) {
+        sf_free(blks[i]);
+    }
+
+    assert_quick_list_block_count(64, 1);
+    void *x = sf_malloc(sz);
+    cr_assert(x == blks[QUICK_LIST_MAX], "Quick list block was not reused!");
+    assert_quick_list_block_count(0, 0);
+
+    // The list must now be empty rather than pointing into the old payload.
+    void *y = sf_malloc(sz);
+    cr_assert_not_null(y, "y is NULL!");
+    cr_assert(y != x, "Same block was returned twice!");
+}
+
+// Testing if the best-fit policy takes the smallest fitting block instead of the first one.
+Test(sfmm_student_suite, best_fit_policy_test, .timeout = TEST_TIMEOUT) {
+    struct sf_placement_policy policy = {SF_BEST_FIT, 8, 0, 0};
+    sf_set_placement_policy(&policy);
+
+    size_t sz_a = 470, sz_b = 310, sz_guard = 184, sz_req = 280;
+    void *a = sf_malloc(sz_a);
+    /* void *g1 = */ sf_malloc(sz_guard);
+    void *b = sf_malloc(sz_b);
+    /* void *g2 = */ sf_malloc(sz_guard);
+
+    // Free list (256, 512] now holds a (480) ahead of b (320).
+    sf_free(b);
+    sf_free(a);
+
+    void *x = sf_malloc(sz_req);
+    cr_assert(x == b, "Best-fit did not choose the smallest block (got %p, exp %p)", x, b);
+    assert_free_block_count(480, 1);
+    assert_free_block_count(32, 1);
+}
+
+// Testing if a request spanning many pages grows the heap by exactly the pages it needs.
+Test(sfmm_student_suite, grow_many_pages_test, .timeout = TEST_TIMEOUT) {
+    size_t sz = 20000;
+    void *x = sf_malloc(sz);
+
+    cr_assert_not_null(x, "x is NULL!");
+    cr_assert(sf_mem_start() + 20 * PAGE_SZ == sf_mem_end(), "Heap is not 20 pages (%ld bytes)",
+              (long) (sf_mem_end() - sf_mem_start()));
+    assert_free_block_count(0, 1);
+    assert_free_block_count(416, 1);
+}
+
+// Testing if repeated grow events grow the heap geometrically.
+Test(sfmm_student_suite, geometric_growth_test, .timeout = TEST_TIMEOUT) {
+    sf_set_growth_factor(2.0);
+    size_t sz = 1500;
+
+    // Grow events of 1, 2 and 4 pages: the last one needs only 1 page but doubles the previous grow.
+    sf_malloc(sz);
+    sf_malloc(sz);
+    sf_malloc(sz);
+
+    cr_assert(sf_mem_start() + 8 * PAGE_SZ == sf_mem_end(), "Heap is not 8 pages (%ld bytes)",
+              (long) (sf_mem_end() - sf_mem_start()));
+    assert_free_block_count(0, 1);
+    assert_free_block_count(3584, 1);
+}
+
+// Testing if a request is served without an error when a geometric grow reaches the end of the heap but covers it.
+Test(sfmm_student_suite, geometric_growth_limit_test, .timeout = TEST_TIMEOUT) {
+    sf_set_growth_factor(2.0);
+    size_t sz = 900;
+
+    // Each grow doubles the previous one, so the last ones ask for more pages than the heap has left.
+    sf_errno = 0;
+    int count = 0;
+    while(sf_malloc(sz)) {
+        cr_assert(sf_errno == 0, "sf_errno is set after successful request %d", count);
+        count++;
+    }
+    cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM");
+    cr_assert(count * (sz + 8) > 20 * PAGE_SZ, "Only %d requests fit in the heap", count);
+}
+
+// Testing if the single arena of a single-threaded build reports the heap's size and free space.
+Test(sfmm_student_suite, arena_stats_test, .timeout = TEST_TIMEOUT) {
+    struct sf_arena_stats stats;
+    void *x = sf_malloc(100);
+
+    cr_assert_not_null(x, "x is NULL!");
+    cr_assert_eq(sf_arena_count(), 1, "Wrong number of arenas");
+    cr_assert_eq(sf_get_arena_stats(0, &stats), 0, "No statistics for arena 0");
+    cr_assert_eq(stats.heap_size, PAGE_SZ, "Wrong heap size (%zu)", stats.heap_size);
+    cr_assert_eq(stats.free_size, 864, "Wrong free size (%zu)", stats.free_size);
+    cr_assert_eq(sf_get_arena_stats(1, &stats), -1, "Statistics for a nonexistent arena");
+}
+
+// Testing if an overflowing quick list flushes only part of its blocks, and if lists out of range are unused.
+Test(sfmm_student_suite, partial_flush_quick_list_test, .timeout = TEST_TIMEOUT) {
+    struct sf_quick_list_config config = {3, 0, 1, 32, 50};
+    sf_set_quick_list_config(&config);
+
+    size_t sz = 50;
+    void *blks[6];
+    for(int i = 0; i < 6; i++) {
+        blks[i] = sf_malloc(sz);
+    }
+    void *x = sf_malloc(100);
+    /* void *guard = */ sf_malloc(sz);
+
+    // The sixth free flushes the two oldest blocks of the full list, which coalesce.
+    for(int i = 0; i < 6; i++) {
+        sf_free(blks[i]);
+    }
+    assert_quick_list_block_count(64, 4);
+    assert_free_block_count(128, 1);
+
+    // Blocks of 112 bytes are beyond the three lists in use, so they go straight to the free lists.
+    sf_free(x);
+    assert_quick_list_block_count(112, 0);
+    assert_free_block_count(112, 1);
+}
+
+// Testing if the capacity of a quick list that keeps overflowing and running empty grows.
+Test(sfmm_student_suite, adaptive_quick_list_test, .timeout = TEST_TIMEOUT) {
+    struct sf_quick_list_config config = {NUM_QUICK_LISTS, 1, 1, 32, 100};
+    sf_set_quick_list_config(&config);
+
+    size_t sz = 50;
+    void *blks[12];
+    for(int round = 0; round < 40; round++) {
+        for(int i = 0; i < 12; i++) {
+            blks[i] = sf_malloc(sz);
+            cr_assert_not_null(blks[i], "blks[%d] is NULL!", i);
+        }
+        for(int i = 0; i < 12; i++) {
+            sf_free(blks[i]);
+        }
+    }
+
+    assert_quick_list_block_count(64, 12);
+}
+
+// Testing if deferred frees are merged when no block fits a request, and when enough frees are pending.
+Test(sfmm_student_suite, deferred_coalesce_test, .timeout = TEST_TIMEOUT) {
+    sf_set_coalesce_threshold(3);
+
+    size_t sz = 200;
+    void *a = sf_malloc(sz);
+    void *b = sf_malloc(sz);
+    void *c = sf_malloc(sz);
+    void *guard = sf_malloc(sz);
+
+    sf_free(a);
+    sf_free(b);
+    assert_free_block_count(208, 2);
+
+    // No single free block fits, so a and b are merged to satisfy the request.
+    void *x = sf_malloc(400);
+    cr_assert(x == a, "Merged block was not used (got %p, exp %p)", x, a);
+    assert_free_block_count(0, 1);
+
+    // The third pending free sweeps the whole heap into one block.
+    sf_free(c);
+    sf_free(x);
+    assert_free_block_count(0, 3);
+    sf_free(guard);
+    assert_free_block_count(0, 1);
+    assert_free_block_count(976, 1);
+}
+
+// Testing if blocks flushed from a quick list or split off a block also wait for the sweep when coalescing is deferred.
+Test(sfmm_student_suite, deferred_flush_split_test, .timeout = TEST_TIMEOUT) {
+    sf_set_coalesce_threshold(100);
+
+    size_t sz = 50;
+    void *blks[QUICK_LIST_MAX + 1];
+    for(int i = 0; i < QUICK_LIST_MAX + 1; i++) {
+        blks[i] = sf_malloc(sz);
+    }
+    void *x = sf_malloc(200);
+    void *y = sf_malloc(200);
+    /* void *guard = */ sf_malloc(200);
+
+    // The last free flushes the others from the quick list, and they stay apart.
+    for(int i = 0; i < QUICK_LIST_MAX + 1; i++) {
+        sf_free(blks[i]);
+    }
+    assert_quick_list_block_count(64, 1);
+    assert_free_block_count(64, QUICK_LIST_MAX);
+
+    // The 96 bytes split off x stay apart from y.
+    sf_free(y);
+    void *x1 = sf_realloc(x, 100);
+    cr_assert(x1 == x, "Block was moved (got %p, exp %p)", x1, x);
+    assert_free_block_count(96, 1);
+    assert_free_block_count(208, 1);
+
+    // Turning deferral off merges them.
+    sf_set_coalesce_threshold(0);
+    assert_free_block_count(64 * QUICK_LIST_MAX, 1);
+    assert_free_block_count(304, 1);
+}
+
+// Testing if realloc grows a block in place into the free block after it, and into the wilderness.
+Test(sfmm_student_suite, realloc_in_place_test, .timeout = TEST_TIMEOUT) {
+    size_t sz = 200;
+    void *x = sf_malloc(sz);
+    void *y = sf_malloc(sz);
+    void *z = sf_malloc(sz);
+    sf_free(y);
+
+    // x absorbs y, and the 48 bytes it does not need are split off.
+    void *x1 = sf_realloc(x, 350);
+    cr_assert(x1 == x, "Block was moved (got %p, exp %p)", x1, x);
+    sf_block *bp = (sf_block *) ((char *) x1 - 16);
+    cr_assert_eq(((bp->header ^ MAGIC) >> 32) & 0xffffffff, 350, "Wrong payload size");
+    assert_free_block_count(48, 1);
+
+    // z is followed by the wilderness, so the heap is extended behind it.
+    void *z1 = sf_realloc(z, 2000);
+    cr_assert(z1 == z, "Block was moved (got %p, exp %p)", z1, z);
+    bp = (sf_block *) ((char *) z1 - 16);
+    cr_assert_eq((bp->header ^ MAGIC) & 0xfffffff0, 2016, "Wrong block size");
+    assert_free_block_count(0, 2);
+}
+
+// Testing if requests above the mmap threshold bypass the heap, and keep their contents when resized.
+Test(sfmm_student_suite, mmap_large_block_test, .timeout = TEST_TIMEOUT) {
+    size_t sz = 200000;
+    char *x = sf_malloc(sz);
+    cr_assert_not_null(x, "x is NULL!");
+    cr_assert(sf_mem_start() == sf_mem_end(), "Large block was taken from the heap");
+
+    memset(x, 'a', sz);
+    x = sf_realloc(x, 2 * sz);
+    cr_assert_not_null(x, "x is NULL after growing!");
+    cr_assert(x[0] == 'a' && x[sz - 1] == 'a', "Contents were not kept when growing");
+
+    // Shrinking to the threshold or below moves the block to the heap.
+    x = sf_realloc(x, 100);
+    cr_assert_not_null(x, "x is NULL after shrinking!");
+    cr_assert(x[0] == 'a' && x[99] == 'a', "Contents were not kept when shrinking");
+    cr_assert((void *) x > sf_mem_start() && (void *) x < sf_mem_end(), "Small block is not in the heap");
+    sf_free(x);
+}
+
+// Testing if the statistics count quick list use, splits and grow events, and describe the free lists.
+Test(sfmm_student_suite, stats_test, .timeout = TEST_TIMEOUT) {
+    struct sf_stats stats;
+    void *x = sf_malloc(50);
+    sf_free(x);
+    x = sf_malloc(50);
+    /* void *y = */ sf_malloc(2000);
+
+    sf_get_stats(&stats);
+    cr_assert_eq(stats.quick_lists[2].hits, 1, "Wrong number of hits (%lu)", (unsigned long) stats.quick_lists[2].hits);
+    cr_assert_eq(stats.quick_lists[2].misses, 1, "Wrong number of misses (%lu)", (unsigned long) stats.quick_lists[2].misses);
+    cr_assert_eq(stats.quick_lists[2].length, 0, "Wrong quick list length (%d)", stats.quick_lists[2].length);
+    cr_assert_eq(stats.splits, 2, "Wrong number of splits (%lu)", (unsigned long) stats.splits);
+    cr_assert_eq(stats.grows, 1, "Wrong number of grow events (%lu)", (unsigned long) stats.grows);
+    cr_assert_eq(stats.requested_bytes, 2050, "Wrong requested bytes (%zu)", stats.requested_bytes);
+    cr_assert_eq(stats.in_use_bytes, 2080, "Wrong bytes in use (%zu)", stats.in_use_bytes);
+    cr_assert_eq(stats.heap_bytes, 3 * PAGE_SZ, "Wrong heap size (%zu)", stats.heap_bytes);
+
+    size_t free_blks = 0, free_bytes = 0;
+    for(int i = 0; i < NUM_FREE_LISTS; i++) {
+        free_blks += stats.free_lists[i].length;
+        free_bytes += stats.free_lists[i].bytes;
+    }
+    cr_assert_eq(free_blks, 1, "Wrong number of free blocks (%zu)", free_blks);
+    cr_assert_eq(free_bytes, 3 * PAGE_SZ - 48 - 2080, "Wrong free bytes (%zu)", free_bytes);
+}
+
+// Testing if the statistics are written to a file in the Prometheus text format.
+Test(sfmm_student_suite, write_stats_test, .timeout = TEST_TIMEOUT) {
+    const char *path = "/tmp/sfmm_stats_test.prom";
+    sf_malloc(50);
+    cr_assert_eq(sf_write_stats(path), 0, "Statistics were not written");
+
+    char line[256];
+    int found = 0;
+    FILE *in = fopen(path, "r");
+    cr_assert_not_null(in, "Statistics file is missing");
+    while(fgets(line, sizeof(line), in)) {
+        if(strcmp(line, "sf_requested_bytes 50\n") == 0) {found = 1;}
+    }
+    fclose(in);
+    remove(path);
+    cr_assert(found, "sf_requested_bytes sample is missing");
+}
+
+// Testing if the recorder writes one entry per call, keeping an object's id across a realloc.
+Test(sfmm_student_suite, record_trace_test, .timeout = TEST_TIMEOUT) {
+    const char *path = "/tmp/sfmm_record_test.sftrace";
+    void *x = sf_malloc(100);
+    cr_assert_eq(sf_record_start(path), 0, "Recording did not start");
+
+    void *y = sf_malloc(200);
+    y = sf_realloc(y, 2000);
+    sf_free(y);
+    sf_free(x);  // Allocated before recording started, so not recorded.
+    cr_assert_eq(sf_record_stop(), 0, "Recording did not stop");
+
+    struct record_header header;
+    struct record_entry entries[4];
+    FILE *in = fopen(path, "r");
+    cr_assert_not_null(in, "Trace file is missing");
+    cr_assert_eq(fread(&header, sizeof(header), 1, in), 1, "Trace header is missing");
+    size_t count = fread(entries, sizeof(entries[0]), 4, in);
+    fclose(in);
+    remove(path);
+
+    cr_assert(memcmp(header.magic, RECORD_MAGIC, 8) == 0, "Wrong magic number");
+    cr_assert_eq(count, 3, "Wrong number of entries (%zu)", count);
+    cr_assert(entries[0].op == RECORD_MALLOC && entries[0].id == 0 && entries[0].size == 200, "Wrong malloc entry");
+    cr_assert(entries[1].op == RECORD_REALLOC && entries[1].id == 0 && entries[1].size == 2000, "Wrong realloc entry");
+    cr_assert(entries[2].op == RECORD_FREE && entries[2].id == 0, "Wrong free entry");
+}
+
+// Testing if aligned blocks are carved out of free blocks without losing the bytes around them.
+Test(sfmm_student_suite, memalign_test, .timeout = TEST_TIMEOUT) {
+    sf_errno = 0;
+    cr_assert_null(sf_memalign(48, 100), "An alignment that is not a power of two was accepted");
+    cr_assert(sf_errno == EINVAL, "sf_errno is not EINVAL");
+
+    char *x = sf_memalign(1024, 100);
+    cr_assert_not_null(x, "x is NULL!");
+    cr_assert((uintptr_t) x % 1024 == 0, "x is not aligned to 1024 bytes");
+    memset(x, 'a', 100);
+
+    // The aligned block is no larger than sf_malloc would make it, and the rest of the heap is in the free lists.
+    sf_block *bp = (sf_block *) (x - 16);
+    size_t blk_size = (bp->header ^ MAGIC) & 0xfffffff0;
+    cr_assert_eq(blk_size, 112, "Aligned block size (%ld) not what was expected (112)", blk_size);
+    size_t free_bytes = 0;
+    for(int i = 0; i < NUM_FREE_LISTS; i++) {
+        for(sf_block *fp = sf_free_list_heads[i].body.links.next; fp != &sf_free_list_heads[i]; fp = fp->body.links.next) {
+            free_bytes += (fp->header ^ MAGIC) & 0xfffffff0;
+        }
+    }
+    size_t heap_size = (char *) sf_mem_end() - (char *) sf_mem_start();
+    cr_assert_eq(free_bytes + blk_size, heap_size - 48, "Bytes around the aligned block were lost");
+
+    x = sf_realloc(x, 300);
+    cr_assert_not_null(x, "x is NULL after growing!");
+    cr_assert(x[0] == 'a' && x[99] == 'a', "Contents were not kept when growing");
+
+    char *ptrs[8];
+    for(int i = 0; i < 8; i++) {
+        sf_size_t align = 32 << i;
+        ptrs[i] = sf_memalign(align, 200 + 24 * i);
+        cr_assert_not_null(ptrs[i], "Allocation aligned to %u bytes is NULL!", align);
+        cr_assert((uintptr_t) ptrs[i] % align == 0, "Allocation is not aligned to %u bytes", align);
+        memset(ptrs[i], i, 200 + 24 * i);
+    }
+    for(int i = 0; i < 8; i++) {
+        sf_free(ptrs[i]);
+    }
+    sf_free(x);
+
+    // Every fragment went back to the free lists, so the heap coalesces into one block again.
+    assert_quick_list_block_count(0, 0);
+    assert_free_block_count(0, 1);
+}
+
+// Testing if aligned requests above the mmap threshold get aligned mappings.
+Test(sfmm_student_suite, memalign_large_test, .timeout = TEST_TIMEOUT) {
+    size_t sz = 200000;
+    char *x = sf_memalign(64, sz);
+    cr_assert_not_null(x, "x is NULL!");
+    cr_assert((uintptr_t) x % 64 == 0, "x is not aligned to 64 bytes");
+    sf_free(x);
+
+    x = sf_aligned_alloc(16384, sz);
+    cr_assert_not_null(x, "x is NULL!");
+    cr_assert((uintptr_t) x % 16384 == 0, "x is not aligned to 16384 bytes");
+    cr_assert(sf_mem_start() == sf_mem_end(), "Large block was taken from the heap");
+
+    memset(x, 'a', sz);
+    x = sf_realloc(x, 4 * sz);
+    cr_assert_not_null(x, "x is NULL after growing!");
+    cr_assert((uintptr_t) x % 4096 == 0, "x is not aligned to a page after growing");
+    cr_assert(x[0] == 'a' && x[sz - 1] == 'a', "Contents were not kept when growing");
+    sf_free(x);
+}
+
+/*
+ * Returns the start of a page mapped after one that cannot be read, so reading a header in front
+ * of the returned pointer faults.
+ */
+static void *guarded_page() {
+    long page_size = sysconf(_SC_PAGESIZE);
+    char *pages = mmap(NULL, 2 * page_size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    cr_assert(pages != MAP_FAILED, "mmap failed!");
+    cr_assert_eq(mprotect(pages, page_size, PROT_NONE), 0, "mprotect failed!");
+    return pages + page_size;
+}
+
+// Testing if invalid pointers placed like aligned large payloads are rejected without reading the page before them.
+Test(sfmm_student_suite, free_invalid_page_test, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+    sf_free(sf_aligned_alloc(4096, 200000));
+    sf_free(guarded_page());
+}
+
+Test(sfmm_student_suite, free_sized_invalid_page_test, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+    sf_free_sized(guarded_page(), 200000);
+}
+
+Test(sfmm_student_suite, realloc_invalid_page_test, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+    sf_realloc(guarded_page(), 100);
+}
+
+Test(sfmm_student_suite, calloc_test, .timeout = TEST_TIMEOUT) {
+    sf_errno = 0;
+    cr_assert_null(sf_calloc(0, 8), "A zero-byte request did not return NULL");
+    cr_assert_null(sf_calloc(0x10000, 0x10000), "A request that overflows sf_size_t did not return NULL");
+    cr_assert(sf_errno == ENOMEM, "sf_errno is not ENOMEM");
+
+    // A recycled block is cleared, including the words the free lists kept in it.
+    size_t sz = 500;
+    char *x = sf_malloc(sz);
+    cr_assert_not_null(x, "x is NULL!");
+    memset(x, 'a', sz);
+    sf_free(x);
+
+    char *y = sf_calloc(50, 10);
+    cr_assert(y == x, "The freed block was not reused");
+    for(size_t i = 0; i < sz; i++) {
+        cr_assert(y[i] == 0, "Byte %ld of a recycled block is not zero", i);
+    }
+
+    // Large blocks are fresh mappings.
+    size_t large_sz = 200000;
+    char *z = sf_calloc(1, large_sz);
+    cr_assert_not_null(z, "z is NULL!");
+    cr_assert(sf_mem_end() - sf_mem_start() < large_sz, "Large block was taken from the heap");
+    cr_assert(z[0] == 0 && z[large_sz / 2] == 0 && z[large_sz - 1] == 0, "Large block is not zero");
+
+    sf_free(y);
+    sf_free(z);
+}
+
+Test(sfmm_student_suite, batch_test, .timeout = TEST_TIMEOUT) {
+    // The blocks are carved one after another from the wilderness.
+    void *ptrs[10];
+    sf_errno = 0;
+    cr_assert(sf_malloc_batch(200, 10, ptrs) == 10, "Not all blocks were allocated");
+    cr_assert(sf_errno == 0, "sf_errno is set after a batch that grew the heap");
+    for(int i = 1; i < 10; i++) {
+        cr_assert((char *) ptrs[i] == (char *) ptrs[i - 1] + 208, "Block %d does not follow block %d", i, i - 1);
+    }
+    for(int i = 0; i < 10; i++) {memset(ptrs[i], 'a', 200);}
+    assert_free_block_count(0, 1);
+
+    // Freeing all but one leaves a run below it, which is merged into one block, and a run above it, which is
+    // merged with the wilderness.
+    void *kept = ptrs[4];
+    void *freed[9] = {ptrs[7], ptrs[2], ptrs[9], ptrs[0], ptrs[5], ptrs[3], ptrs[8], ptrs[1], ptrs[6]};
+    sf_free_batch(freed, 9);
+    assert_quick_list_block_count(0, 0);
+    assert_free_block_count(0, 2);
+    assert_free_block_count(4 * 208, 1);
+
+    sf_free(kept);
+    assert_free_block_count(0, 1);
+}
+
+Test(sfmm_student_suite, free_sized_test, .timeout = TEST_TIMEOUT) {
+    // The block takes the whole first free block, splinter included, so its header disagrees with the size.
+    void *x = sf_malloc(950);
+    cr_assert_not_null(x, "x is NULL!");
+    sf_free_sized(x, 950);
+    assert_quick_list_block_count(0, 0);
+    assert_free_block_count(0, 1);
+    assert_free_block_count(976, 1);
+
+    void *y = sf_malloc(100);
+    cr_assert_not_null(y, "y is NULL!");
+    sf_free_sized(y, 100);
+    assert_quick_list_block_count(0, 1);
+    assert_quick_list_block_count(112, 1);
+    assert_free_block_count(0, 1);
+    assert_free_block_count(864, 1);
+}
+
+#ifdef SF_HARDENED
+Test(sfmm_student_suite, free_sized_wrong_size_test, .timeout = TEST_TIMEOUT, .signal = SIGABRT) {
+    void *x = sf_malloc(100);
+    cr_assert_not_null(x, "x is NULL!");
+    sf_free_sized(x, 200);
+}
+#endif
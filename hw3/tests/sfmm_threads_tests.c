@@ -0,0 +1,117 @@
+#ifdef SF_THREADS
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <pthread.h>
+#include <string.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#define TEST_TIMEOUT 15
+
+/*
+ * Tests of the threaded build, built and run by make threads. The tests in sfmm_tests.c assume
+ * the single-threaded heap layout, so they are not run in that build.
+ */
+
+// Size of the prologue and epilogue of an arena's heap.
+#define HEAP_OVERHEAD 48
+
+#define NUM_BLOCKS 8
+
+static void *blocks[NUM_BLOCKS];
+
+// Frees the blocks allocated by another thread.
+static void *free_blocks(void *arg) {
+    for(int i = 0; i < NUM_BLOCKS; i++) {
+        sf_free(blocks[i]);
+    }
+    return NULL;
+}
+
+// Allocates and frees small blocks, which stay in the thread's cache, and returns the bytes in use then.
+static void *cache_blocks(void *arg) {
+    for(int i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = sf_malloc(50);
+        cr_assert_not_null(blocks[i], "blocks[%d] is NULL!", i);
+    }
+    for(int i = 0; i < NUM_BLOCKS; i++) {
+        sf_free(blocks[i]);
+    }
+
+    size_t *in_use = (size_t *) arg;
+    *in_use = 0;
+    for(int i = 0; i < sf_arena_count(); i++) {
+        struct sf_arena_stats stats;
+        sf_get_arena_stats(i, &stats);
+        *in_use += stats.heap_size - stats.free_size;
+    }
+    return NULL;
+}
+
+Test(sfmm_threads_suite, remote_free_test, .timeout = TEST_TIMEOUT) {
+    for(int i = 0; i < NUM_BLOCKS; i++) {
+        blocks[i] = sf_malloc(500);
+        cr_assert_not_null(blocks[i], "blocks[%d] is NULL!", i);
+    }
+
+    pthread_t thread;
+    pthread_create(&thread, NULL, free_blocks, NULL);
+    pthread_join(thread, NULL);
+
+    // The blocks are queued for this thread's arena, which frees them on its next trip to the arena.
+    uint64_t remote_frees = 0;
+    for(int i = 0; i < sf_arena_count(); i++) {
+        struct sf_arena_stats stats;
+        cr_assert_eq(sf_get_arena_stats(i, &stats), 0, "No stats for arena %d", i);
+        remote_frees += stats.remote_frees;
+        if(stats.heap_size) {
+            cr_assert_eq(stats.heap_size - stats.free_size, HEAP_OVERHEAD, "Arena %d still has blocks in use", i);
+        }
+    }
+    cr_assert_eq(remote_frees, NUM_BLOCKS, "Wrong number of remote frees (exp=%d, found=%lu)",
+                 NUM_BLOCKS, (unsigned long) remote_frees);
+}
+
+Test(sfmm_threads_suite, thread_exit_drain_test, .timeout = TEST_TIMEOUT) {
+    size_t in_use;
+    pthread_t thread;
+    pthread_create(&thread, NULL, cache_blocks, &in_use);
+    pthread_join(thread, NULL);
+
+    // The cached blocks count as in use while the thread runs, and are returned when it exits.
+    cr_assert(in_use > HEAP_OVERHEAD, "The thread's cache held no blocks");
+    for(int i = 0; i < sf_arena_count(); i++) {
+        struct sf_arena_stats stats;
+        sf_get_arena_stats(i, &stats);
+        if(stats.heap_size) {
+            cr_assert_eq(stats.heap_size - stats.free_size, HEAP_OVERHEAD, "Arena %d still has blocks in use", i);
+        }
+    }
+}
+
+Test(sfmm_threads_suite, arena_fallback_test, .timeout = TEST_TIMEOUT) {
+    // One thread allocates until every arena is full.
+    static void *ptrs[1000];
+    int count = 0;
+    sf_errno = 0;
+    while(count < 1000 && (ptrs[count] = sf_malloc(1000))) {
+        count++;
+    }
+    cr_assert(count < 1000, "The arenas never filled up");
+    cr_assert_eq(sf_errno, ENOMEM, "sf_errno is not ENOMEM!");
+
+    size_t heap_size = 0;
+    for(int i = 0; i < sf_arena_count(); i++) {
+        struct sf_arena_stats stats;
+        sf_get_arena_stats(i, &stats);
+        cr_assert(stats.heap_size > 0, "Arena %d was not used", i);
+        heap_size += stats.heap_size;
+    }
+    cr_assert(count * 1000 > heap_size / 2, "Only %d blocks fit in %zu bytes of arenas", count, heap_size);
+
+    // Once they are freed, the thread's own arena serves it again.
+    for(int i = 0; i < count; i++) {
+        sf_free(ptrs[i]);
+    }
+    cr_assert_not_null(sf_malloc(1000), "No memory after freeing the blocks!");
+}
+#endif
@@ -0,0 +1,436 @@
+#define _DEFAULT_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <math.h>
+#include <time.h>
+#include <sched.h>
+#include <pthread.h>
+#include <malloc.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/wait.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "bench.h"
+
+/*
+ * Macro benchmark suite: runs a set of standard workloads against the allocator and against the
+ * C library's malloc as a baseline, and reports for each the throughput, the 50th, 99th and 99.9th
+ * percentile latency of a single call, the peak heap size and the fragmentation.
+ *
+ *     sfmm_bench [workload...]
+ *
+ * With no arguments every workload is run. Each workload makes the same sequence of requests to
+ * both allocators, and is run twice per allocator, each time in a fresh child process so that it
+ * starts from an empty heap. The first run only measures throughput. The second times every call
+ * with clock_gettime, so its latencies include the cost of one clock read, and samples the heap
+ * size every SAMPLE_PERIOD calls, outside the timed region. The fragmentation is
+ * sf_internal_fragmentation() at the end of the workload, before its live objects are freed. The
+ * C library does not report it. Its heap size is taken from mallinfo2() where that exists.
+ *
+ * The sfutil heap is capped at 24 KiB, so the workloads keep their live sets small. Requests the
+ * allocator could not satisfy are counted as failed.
+ */
+
+#define OPS           400000
+#define LAT_CAP       (OPS + 4096)  /* Room for the calls made after the last full step and during teardown. */
+#define SAMPLE_PERIOD 1024
+
+#define CHURN_LIVE    128
+#define POWER_LIVE    64
+#define POWER_MIN     16
+#define POWER_MAX     1024
+#define MIX_LONG      24
+#define MIX_SHORT     8
+#define GROW_BUFFERS  4
+#define GROW_CHUNK    64
+#define GROW_MAX      2048
+#define RING_SIZE     16   /* Must be a power of two. */
+
+struct allocator {
+    const char* name;
+    void* (*malloc)(size_t size);
+    void* (*realloc)(void* ptr, size_t size);
+    void (*free)(void* ptr);
+    size_t (*heap_size)(void);
+    double (*fragmentation)(void);  // NULL if the allocator does not report it.
+    int serialize;                  // Nonzero if calls from several threads must be made under one lock.
+};
+
+// State of one thread running a workload.
+struct run {
+    const struct allocator* alloc;
+    uint32_t* lat;      // Latency of each call in ns, or NULL in the throughput run.
+    size_t ops;         // Calls made.
+    long failed;        // Calls that returned NULL.
+    int locked;         // If nonzero, calls are made under call_mutex.
+    int sampler;        // If nonzero, this thread samples the heap.
+    size_t peak_heap;
+    double frag;
+};
+
+struct workload {
+    const char* name;
+    void (*fn)(struct run* run);
+};
+
+struct result {
+    double seconds;
+    size_t ops;
+    long failed;
+    size_t peak_heap;
+    double frag;
+    uint32_t p50, p99, p999;
+};
+
+static pthread_mutex_t call_mutex = PTHREAD_MUTEX_INITIALIZER;
+
+static void* sfmm_malloc(size_t size) {return sf_malloc(size);}
+static void* sfmm_realloc(void* ptr, size_t size) {return sf_realloc(ptr, size);}
+static void sfmm_free(void* ptr) {sf_free(ptr);}
+static double sfmm_fragmentation() {return sf_internal_fragmentation();}
+
+static size_t sfmm_heap_size() {
+    struct sf_stats stats;
+    sf_get_stats(&stats);
+    return stats.heap_bytes;
+}
+
+// Returns the bytes the C library holds in its arenas and in mappings of its own, or 0 if it cannot tell.
+static size_t libc_heap_size() {
+#if defined(__GLIBC__) && (__GLIBC__ > 2 || __GLIBC_MINOR__ >= 33)
+    struct mallinfo2 info = mallinfo2();
+    return info.arena + info.hblkhd;
+#else
+    return 0;
+#endif
+}
+
+static const struct allocator allocators[] = {
+#ifdef SF_THREADS
+    {"sfmm", sfmm_malloc, sfmm_realloc, sfmm_free, sfmm_heap_size, sfmm_fragmentation, 0},
+#else
+    {"sfmm", sfmm_malloc, sfmm_realloc, sfmm_free, sfmm_heap_size, sfmm_fragmentation, 1},
+#endif
+    {"libc", malloc, realloc, free, libc_heap_size, NULL, 0},
+};
+
+// Records the heap size and fragmentation.
+static void sample(struct run* run) {
+    if(run->locked) {pthread_mutex_lock(&call_mutex);}
+    size_t heap = run->alloc->heap_size();
+    double frag = run->alloc->fragmentation ? run->alloc->fragmentation() : NAN;
+    if(run->locked) {pthread_mutex_unlock(&call_mutex);}
+
+    if(heap > run->peak_heap) {run->peak_heap = heap;}
+    run->frag = frag;
+}
+
+// Samples the heap at the end of a workload, before its live objects are freed.
+static void checkpoint(struct run* run) {
+    if(run->lat && run->sampler) {sample(run);}
+}
+
+// Given the time a call started, records its latency, and samples the heap every SAMPLE_PERIOD calls.
+static void op_done(struct run* run, uint64_t start) {
+    if(run->lat) {
+        run->lat[run->ops] = now_ns() - start;
+        if(run->sampler && (run->ops + 1) % SAMPLE_PERIOD == 0) {sample(run);}
+    }
+    run->ops++;
+}
+
+static void* bench_malloc(struct run* run, size_t size) {
+    uint64_t start = run->lat ? now_ns() : 0;
+    if(run->locked) {pthread_mutex_lock(&call_mutex);}
+    void* ptr = run->alloc->malloc(size);
+    if(run->locked) {pthread_mutex_unlock(&call_mutex);}
+    op_done(run, start);
+
+    if(!ptr) {run->failed++;}
+    else {*(char*) ptr = 1;}
+    return ptr;
+}
+
+static void* bench_realloc(struct run* run, void* ptr, size_t size) {
+    uint64_t start = run->lat ? now_ns() : 0;
+    if(run->locked) {pthread_mutex_lock(&call_mutex);}
+    void* new_ptr = run->alloc->realloc(ptr, size);
+    if(run->locked) {pthread_mutex_unlock(&call_mutex);}
+    op_done(run, start);
+
+    if(!new_ptr) {run->failed++;}
+    return new_ptr;
+}
+
+static void bench_free(struct run* run, void* ptr) {
+    uint64_t start = run->lat ? now_ns() : 0;
+    if(run->locked) {pthread_mutex_lock(&call_mutex);}
+    run->alloc->free(ptr);
+    if(run->locked) {pthread_mutex_unlock(&call_mutex);}
+    op_done(run, start);
+}
+
+// A pool of live objects of 16 to 128 bytes, where a random one is repeatedly freed and replaced.
+static void small_churn(struct run* run) {
+    void* objs[CHURN_LIVE] = {0};
+    uint32_t rng = 2463534242u;
+
+    while(run->ops < OPS) {
+        int i = next_rand(&rng) % CHURN_LIVE;
+        if(objs[i]) {bench_free(run, objs[i]);}
+        objs[i] = bench_malloc(run, 16 + next_rand(&rng) % 113);
+    }
+
+    checkpoint(run);
+    for(int i = 0; i < CHURN_LIVE; i++) {
+        if(objs[i]) {bench_free(run, objs[i]);}
+    }
+}
+
+// Returns a size from a Pareto distribution with shape 1, starting at POWER_MIN and cut off at POWER_MAX.
+static size_t power_law_size(uint32_t* rng) {
+    double u = (next_rand(rng) + 1.0) / 4294967296.0;
+    double size = POWER_MIN / u;
+    return size < POWER_MAX ? (size_t) size : POWER_MAX;
+}
+
+// Like small_churn, but most requests are small and a few are large.
+static void power_law(struct run* run) {
+    void* objs[POWER_LIVE] = {0};
+    uint32_t rng = 88675123u;
+
+    while(run->ops < OPS) {
+        int i = next_rand(&rng) % POWER_LIVE;
+        if(objs[i]) {bench_free(run, objs[i]);}
+        objs[i] = bench_malloc(run, power_law_size(&rng));
+    }
+
+    checkpoint(run);
+    for(int i = 0; i < POWER_LIVE; i++) {
+        if(objs[i]) {bench_free(run, objs[i]);}
+    }
+}
+
+// Long-lived objects of 128 to 512 bytes that are occasionally replaced, among short-lived objects
+// of 16 to 256 bytes that are freed after MIX_SHORT further requests.
+static void mixed_lifetimes(struct run* run) {
+    void* long_objs[MIX_LONG] = {0};
+    void* short_objs[MIX_SHORT] = {0};
+    uint32_t rng = 521288629u;
+
+    for(int i = 0; i < MIX_LONG; i++) {
+        long_objs[i] = bench_malloc(run, 128 + next_rand(&rng) % 385);
+    }
+
+    for(unsigned long step = 0; run->ops < OPS; step++) {
+        if(next_rand(&rng) % 64 == 0) {
+            int i = next_rand(&rng) % MIX_LONG;
+            if(long_objs[i]) {bench_free(run, long_objs[i]);}
+            long_objs[i] = bench_malloc(run, 128 + next_rand(&rng) % 385);
+        }
+        else {
+            int i = step % MIX_SHORT;
+            if(short_objs[i]) {bench_free(run, short_objs[i]);}
+            short_objs[i] = bench_malloc(run, 16 + next_rand(&rng) % 241);
+        }
+    }
+
+    checkpoint(run);
+    for(int i = 0; i < MIX_LONG; i++) {
+        if(long_objs[i]) {bench_free(run, long_objs[i]);}
+    }
+    for(int i = 0; i < MIX_SHORT; i++) {
+        if(short_objs[i]) {bench_free(run, short_objs[i]);}
+    }
+}
+
+// Buffers grown side by side a chunk at a time with realloc up to GROW_MAX bytes, then freed.
+static void realloc_grow(struct run* run) {
+    while(run->ops < OPS) {
+        char* bufs[GROW_BUFFERS] = {0};
+
+        for(size_t len = GROW_CHUNK; len <= GROW_MAX; len += GROW_CHUNK) {
+            for(int i = 0; i < GROW_BUFFERS; i++) {
+                char* buf = bufs[i] ? bench_realloc(run, bufs[i], len) : bench_malloc(run, len);
+                if(!buf) {continue;}
+                memset(buf + len - GROW_CHUNK, i, GROW_CHUNK);
+                bufs[i] = buf;
+            }
+        }
+
+        if(run->ops >= OPS) {checkpoint(run);}
+        for(int i = 0; i < GROW_BUFFERS; i++) {
+            if(bufs[i]) {bench_free(run, bufs[i]);}
+        }
+    }
+}
+
+static void* ring[RING_SIZE];
+static unsigned long ring_head, ring_tail;
+
+// Frees the messages in the ring until it finds a NULL message.
+static void* consumer(void* arg) {
+    struct run* run = arg;
+    for(;;) {
+        unsigned long tail = __atomic_load_n(&ring_tail, __ATOMIC_RELAXED);
+        while(__atomic_load_n(&ring_head, __ATOMIC_ACQUIRE) == tail) {sched_yield();}
+        void* msg = ring[tail & (RING_SIZE - 1)];
+        __atomic_store_n(&ring_tail, tail + 1, __ATOMIC_RELEASE);
+
+        if(!msg) {break;}
+        bench_free(run, msg);
+    }
+    return NULL;
+}
+
+// Passes the given message to the consumer, waiting for room in the ring.
+static void ring_put(void* msg) {
+    unsigned long head = __atomic_load_n(&ring_head, __ATOMIC_RELAXED);
+    while(head - __atomic_load_n(&ring_tail, __ATOMIC_ACQUIRE) == RING_SIZE) {sched_yield();}
+    ring[head & (RING_SIZE - 1)] = msg;
+    __atomic_store_n(&ring_head, head + 1, __ATOMIC_RELEASE);
+}
+
+// Messages of 64 to 512 bytes allocated by this thread and freed by another. Half the calls are made by each.
+static void producer_consumer(struct run* run) {
+    run->locked = run->alloc->serialize;
+
+    // The consumer's latencies go in the second half of the buffer and are moved after the producer's at the end.
+    struct run cons = {run->alloc, run->lat ? run->lat + LAT_CAP / 2 : NULL, 0, 0, run->locked, 0, 0, NAN};
+    pthread_t thread;
+    pthread_create(&thread, NULL, consumer, &cons);
+
+    uint32_t rng = 123456789u;
+    while(run->ops < OPS / 2) {
+        void* msg = bench_malloc(run, 64 + next_rand(&rng) % 449);
+        if(msg) {ring_put(msg);}
+    }
+
+    checkpoint(run);
+    ring_put(NULL);
+    pthread_join(thread, NULL);
+
+    if(run->lat) {memmove(run->lat + run->ops, cons.lat, cons.ops * sizeof(*cons.lat));}
+    run->ops += cons.ops;
+}
+
+static const struct workload workloads[] = {
+    {"small_churn", small_churn},
+    {"power_law", power_law},
+    {"mixed_lifetimes", mixed_lifetimes},
+    {"realloc_grow", realloc_grow},
+    {"producer_consumer", producer_consumer},
+};
+
+static int compare_lat(const void* a, const void* b) {
+    uint32_t x = *(const uint32_t*) a, y = *(const uint32_t*) b;
+    return (x > y) - (x < y);
+}
+
+// Runs the workload once in this process and fills in the result.
+static void run_workload(const struct allocator* alloc, const struct workload* workload, int timed,
+                         struct result* result) {
+    struct run run = {alloc, NULL, 0, 0, 0, 1, 0, NAN};
+
+    // The buffer is mapped rather than allocated so that it does not count towards the C library's heap.
+    if(timed) {
+        run.lat = mmap(NULL, LAT_CAP * sizeof(*run.lat), PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if(run.lat == MAP_FAILED) {
+            perror("mmap");
+            exit(EXIT_FAILURE);
+        }
+    }
+
+    uint64_t start = now_ns();
+    workload->fn(&run);
+    result->seconds = (now_ns() - start) / 1e9;
+
+    result->ops = run.ops;
+    result->failed = run.failed;
+    result->peak_heap = run.peak_heap;
+    result->frag = run.frag;
+
+    if(timed && run.ops) {
+        qsort(run.lat, run.ops, sizeof(*run.lat), compare_lat);
+        result->p50 = run.lat[(size_t) (0.5 * (run.ops - 1))];
+        result->p99 = run.lat[(size_t) (0.99 * (run.ops - 1))];
+        result->p999 = run.lat[(size_t) (0.999 * (run.ops - 1))];
+    }
+}
+
+// Runs the workload in a child process, so that it starts from an empty heap. Returns -1 if the child failed.
+static int run_child(const struct allocator* alloc, const struct workload* workload, int timed,
+                     struct result* result) {
+    int fds[2];
+    if(pipe(fds) < 0) {return -1;}
+
+    pid_t pid = fork();
+    if(pid < 0) {return -1;}
+    if(pid == 0) {
+        close(fds[0]);
+        run_workload(alloc, workload, timed, result);
+        ssize_t n = write(fds[1], result, sizeof(*result));
+        _exit(n == sizeof(*result) ? EXIT_SUCCESS : EXIT_FAILURE);
+    }
+
+    close(fds[1]);
+    ssize_t n = read(fds[0], result, sizeof(*result));
+    close(fds[0]);
+
+    int status;
+    waitpid(pid, &status, 0);
+    return n == sizeof(*result) && WIFEXITED(status) && WEXITSTATUS(status) == EXIT_SUCCESS ? 0 : -1;
+}
+
+// Returns nonzero if the workload was named on the command line, or if none were.
+static int selected(const char* name, int argc, char const *argv[]) {
+    if(argc < 2) {return 1;}
+    for(int i = 1; i < argc; i++) {
+        if(strcmp(argv[i], name) == 0) {return 1;}
+    }
+    return 0;
+}
+
+int main(int argc, char const *argv[]) {
+    int num_workloads = sizeof(workloads) / sizeof(workloads[0]);
+    for(int i = 1; i < argc; i++) {
+        int known = 0;
+        for(int w = 0; w < num_workloads; w++) {
+            if(strcmp(argv[i], workloads[w].name) == 0) {known = 1;}
+        }
+        if(!known) {
+            fprintf(stderr, "usage: %s [workload...]\nworkloads:", argv[0]);
+            for(int w = 0; w < num_workloads; w++) {fprintf(stderr, " %s", workloads[w].name);}
+            fprintf(stderr, "\n");
+            return EXIT_FAILURE;
+        }
+    }
+
+    printf("%-18s %-6s %10s %8s %8s %8s %10s %8s %8s\n", "workload", "alloc", "Mops/s", "p50 ns", "p99 ns",
+           "p999 ns", "peak heap", "frag", "failed");
+    fflush(stdout);
+
+    for(int w = 0; w < num_workloads; w++) {
+        if(!selected(workloads[w].name, argc, argv)) {continue;}
+
+        for(int a = 0; a < sizeof(allocators) / sizeof(allocators[0]); a++) {
+            struct result throughput, timed;
+            if(run_child(&allocators[a], &workloads[w], 0, &throughput) < 0 ||
+               run_child(&allocators[a], &workloads[w], 1, &timed) < 0) {
+                printf("%-18s %-6s %10s\n", workloads[w].name, allocators[a].name, "failed");
+                continue;
+            }
+
+            printf("%-18s %-6s %10.2f %8u %8u %8u %10zu ", workloads[w].name, allocators[a].name,
+                   throughput.ops / throughput.seconds / 1e6, timed.p50, timed.p99, timed.p999, timed.peak_heap);
+            if(isnan(timed.frag)) {printf("%8s", "-");}
+            else {printf("%8.3f", timed.frag);}
+            printf(" %8ld\n", throughput.failed);
+            fflush(stdout);
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
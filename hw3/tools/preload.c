@@ -0,0 +1,257 @@
+#define _GNU_SOURCE
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <dlfcn.h>
+#include <malloc.h>
+#include <pthread.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "helper.h"
+#include "arena.h"
+#include "large.h"
+#include "slab.h"
+
+/*
+ * Replaces the C library's allocator in an unmodified program:
+ *
+ *     make preload
+ *     LD_PRELOAD=bin/libsfmm.so program
+ *
+ * malloc, free, calloc, realloc, memalign, posix_memalign, aligned_alloc and malloc_usable_size
+ * are served by sf_malloc, sf_calloc, sf_memalign, sf_free and sf_realloc. The library is built
+ * threaded, since most programs of interest are.
+ *
+ * Pointers the allocator did not hand out are foreign. They come from three places, and each
+ * call that takes a pointer checks whether sfmm owns it before passing it on:
+ *
+ *  - The real allocator, found with dlsym(RTLD_NEXT). Requests sfmm cannot serve fall back to it.
+ *    These are requests too large for sf_size_t, and any request after the heap runs out,
+ *    which in practice soon happens because the sfutil heap is small.
+ *    Allocations made while an sfmm call is in progress also go to it. These include sfutil's own
+ *    heap and the stdio buffers of statistics export and recording.
+ *  - A static bootstrap buffer, which serves the allocations dlsym makes while the real
+ *    allocator is being looked up. Its blocks are never reused.
+ *  - Memory the program got before the library was loaded, which cannot happen with LD_PRELOAD.
+ */
+
+// Size of the buffer that serves allocations made while the real allocator is looked up.
+#define BOOTSTRAP_SIZE 4096
+
+// Largest request passed to sfmm. A block adds a header and padding to it, which must still fit a block size.
+#define SF_MAX_REQUEST (UINT32_MAX - 64)
+
+// Set by the shim while it is inside an sfmm call, or looking up the real allocator.
+static __thread int in_sfmm __attribute__((tls_model("initial-exec")));
+static __thread int resolving __attribute__((tls_model("initial-exec")));
+
+static void* (*real_malloc)(size_t);
+static void (*real_free)(void*);
+static void* (*real_calloc)(size_t, size_t);
+static void* (*real_realloc)(void*, size_t);
+static void* (*real_memalign)(size_t, size_t);
+static size_t (*real_malloc_usable_size)(void*);
+
+static char bootstrap[BOOTSTRAP_SIZE] __attribute__((aligned(16)));
+static size_t bootstrap_used;
+
+// sfutil.o refers to stderr from code that is not position-independent, so the build renames that reference to
+// this variable, which the library can resolve at link time.
+FILE* sfutil_stderr;
+
+// Returns nonzero if the given address is in the bootstrap buffer.
+static int is_bootstrap(void* ptr) {
+    return (char*) ptr >= bootstrap && (char*) ptr < bootstrap + BOOTSTRAP_SIZE;
+}
+
+// Allocates from the bootstrap buffer. Each block is preceded by 16 bytes that hold its size.
+static void* bootstrap_malloc(size_t size) {
+    size_t blk_size = 16 + ((size + 15) & ~(size_t) 15);
+    size_t offset = __atomic_fetch_add(&bootstrap_used, blk_size, __ATOMIC_RELAXED);
+    if(size > BOOTSTRAP_SIZE || offset + blk_size > BOOTSTRAP_SIZE) {
+        errno = ENOMEM;
+        return NULL;
+    }
+
+    *(size_t*) (bootstrap + offset) = size;
+    return bootstrap + offset + 16;
+}
+
+static size_t bootstrap_size(void* ptr) {
+    return *(size_t*) ((char*) ptr - 16);
+}
+
+// Fork handlers. The child must not inherit an arena locked by a thread it does not have.
+static void fork_prepare() {
+    in_sfmm++;
+    arena_lock_all();
+}
+
+static void fork_done() {
+    arena_unlock_all();
+    in_sfmm--;
+}
+
+// Looks up the real allocator on first use.
+static void resolve() {
+    if(resolving || __atomic_load_n(&real_malloc, __ATOMIC_ACQUIRE)) {return;}
+
+    resolving++;
+    real_free = dlsym(RTLD_NEXT, "free");
+    real_calloc = dlsym(RTLD_NEXT, "calloc");
+    real_realloc = dlsym(RTLD_NEXT, "realloc");
+    real_memalign = dlsym(RTLD_NEXT, "memalign");
+    real_malloc_usable_size = dlsym(RTLD_NEXT, "malloc_usable_size");
+    void* found = dlsym(RTLD_NEXT, "malloc");
+    resolving--;
+
+    if(!found) {
+        static const char msg[] = "libsfmm: cannot find the real malloc\n";
+        fwrite(msg, 1, sizeof(msg) - 1, stderr);
+        abort();
+    }
+    sfutil_stderr = stderr;
+
+    // Only the thread that publishes the real allocator registers the fork handlers.
+    void* expected = NULL;
+    if(__atomic_compare_exchange_n(&real_malloc, &expected, found, 0, __ATOMIC_RELEASE, __ATOMIC_RELAXED)) {
+        in_sfmm++;
+        pthread_atfork(fork_prepare, fork_done, fork_done);
+        in_sfmm--;
+    }
+}
+
+// Returns the bytes usable from the given address if sfmm handed it out, or 0 if it is foreign.
+static size_t owned_size(void* ptr) {
+    if(arena_of(ptr)) {return get_blk_size((sf_block*) ((char*) ptr - 16)) - 8;}
+    if(slab_owns(ptr)) {return slab_usable_size(ptr);}
+    if(large_owns(ptr)) {return large_usable_size(ptr);}
+    return 0;
+}
+
+void* malloc(size_t size) {
+    if(resolving) {return bootstrap_malloc(size);}
+    resolve();
+    if(in_sfmm || size > SF_MAX_REQUEST) {return real_malloc(size);}
+
+    // sf_malloc returns NULL for a zero-byte request, where malloc returns a unique pointer.
+    in_sfmm++;
+    void* ptr = sf_malloc(size ? size : 1);
+    in_sfmm--;
+
+    return ptr ? ptr : real_malloc(size);
+}
+
+void free(void* ptr) {
+    if(!ptr || is_bootstrap(ptr)) {return;}
+    resolve();
+
+    if(!owned_size(ptr)) {
+        real_free(ptr);
+        return;
+    }
+
+    in_sfmm++;
+    sf_free(ptr);
+    in_sfmm--;
+}
+
+void* calloc(size_t count, size_t size) {
+    size_t total;
+    if(__builtin_mul_overflow(count, size, &total)) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    if(resolving) {return bootstrap_malloc(total);}
+    resolve();
+    if(in_sfmm || total > SF_MAX_REQUEST) {return real_calloc(count, size);}
+
+    in_sfmm++;
+    void* ptr = sf_calloc(1, total ? total : 1);
+    in_sfmm--;
+
+    return ptr ? ptr : real_calloc(count, size);
+}
+
+void* realloc(void* ptr, size_t size) {
+    if(!ptr) {return malloc(size);}
+    if(!size) {
+        free(ptr);
+        return NULL;
+    }
+
+    // A bootstrap block moves to the real allocator or sfmm.
+    if(is_bootstrap(ptr)) {
+        void* new_ptr = malloc(size);
+        if(new_ptr) {memcpy(new_ptr, ptr, bootstrap_size(ptr) < size ? bootstrap_size(ptr) : size);}
+        return new_ptr;
+    }
+    resolve();
+
+    size_t old_size = owned_size(ptr);
+    if(!old_size) {return real_realloc(ptr, size);}
+
+    if(size <= SF_MAX_REQUEST) {
+        in_sfmm++;
+        void* new_ptr = sf_realloc(ptr, size);
+        in_sfmm--;
+        if(new_ptr) {return new_ptr;}
+    }
+
+    // sfmm has no room for the new size, so the block moves to the real allocator.
+    void* new_ptr = real_malloc(size);
+    if(!new_ptr) {return NULL;}
+    memcpy(new_ptr, ptr, old_size < size ? old_size : size);
+
+    in_sfmm++;
+    sf_free(ptr);
+    in_sfmm--;
+
+    return new_ptr;
+}
+
+void* memalign(size_t alignment, size_t size) {
+    if(!alignment || (alignment & (alignment - 1))) {
+        errno = EINVAL;
+        return NULL;
+    }
+
+    // Payloads are 16-byte aligned, so only larger alignments need sf_memalign.
+    if(alignment <= 16) {return malloc(size);}
+    if(resolving) {
+        errno = ENOMEM;
+        return NULL;
+    }
+    resolve();
+    if(in_sfmm || size > SF_MAX_REQUEST || alignment > SF_MAX_REQUEST) {return real_memalign(alignment, size);}
+
+    in_sfmm++;
+    void* ptr = sf_memalign(alignment, size ? size : 1);
+    in_sfmm--;
+
+    return ptr ? ptr : real_memalign(alignment, size);
+}
+
+int posix_memalign(void** memptr, size_t alignment, size_t size) {
+    if(!alignment || alignment % sizeof(void*) || (alignment & (alignment - 1))) {return EINVAL;}
+
+    void* ptr = memalign(alignment, size);
+    if(!ptr) {return ENOMEM;}
+
+    *memptr = ptr;
+    return 0;
+}
+
+void* aligned_alloc(size_t alignment, size_t size) {
+    return memalign(alignment, size);
+}
+
+size_t malloc_usable_size(void* ptr) {
+    if(!ptr) {return 0;}
+    if(is_bootstrap(ptr)) {return bootstrap_size(ptr);}
+    resolve();
+
+    size_t size = owned_size(ptr);
+    return size ? size : real_malloc_usable_size(ptr);
+}
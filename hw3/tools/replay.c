@@ -0,0 +1,174 @@
+#define _POSIX_C_SOURCE 200809L
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "sfmm.h"
+#include "sfmm_ext.h"
+#include "record.h"
+#include "bench.h"
+
+/*
+ * Replays an allocation trace against the allocator as fast as it can, then reports the
+ * throughput, the final heap size and the fragmentation curve.
+ *
+ *     sfmm_replay [-n samples] trace
+ *
+ * The trace is either a binary trace written by sf_record_start(), which is memory-mapped, or a
+ * CMU malloclab .rep trace, which is parsed into memory first. The recorded timestamps are not
+ * reproduced. The curve is sampled at the given number of evenly spaced points (20 by default),
+ * and sampling time is excluded from the throughput.
+ */
+
+// Maps a binary trace. Returns its entries and sets count, or returns NULL if the file is not a binary trace.
+static const struct record_entry* map_trace(int fd, size_t file_size, size_t* count) {
+    if(file_size < sizeof(struct record_header)) {return NULL;}
+
+    void* map = mmap(NULL, file_size, PROT_READ, MAP_PRIVATE, fd, 0);
+    if(map == MAP_FAILED) {return NULL;}
+
+    const struct record_header* header = (const struct record_header*) map;
+    if(memcmp(header->magic, RECORD_MAGIC, sizeof(header->magic)) != 0 || header->version != RECORD_VERSION ||
+       header->entry_size != sizeof(struct record_entry)) {
+        munmap(map, file_size);
+        return NULL;
+    }
+
+    *count = (file_size - sizeof(*header)) / sizeof(struct record_entry);
+    return (const struct record_entry*) (header + 1);
+}
+
+// Parses a CMU malloclab trace: a header of heap size, id count, op count and weight, then one "a id size",
+// "r id size" or "f id" line per op. Returns the ops as entries and sets count, or returns NULL if it is malformed.
+static const struct record_entry* parse_rep(FILE* in, size_t* count) {
+    unsigned long heap_size, ids, ops, weight;
+    if(fscanf(in, "%lu %lu %lu %lu", &heap_size, &ids, &ops, &weight) != 4) {return NULL;}
+
+    struct record_entry* entries = calloc(ops ? ops : 1, sizeof(*entries));
+    if(!entries) {return NULL;}
+
+    size_t n = 0;
+    char op[2];
+    unsigned long id, size;
+    while(n < ops && fscanf(in, "%1s %lu", op, &id) == 2) {
+        entries[n].id = id;
+        if(op[0] == 'a' || op[0] == 'r') {
+            if(fscanf(in, "%lu", &size) != 1) {break;}
+            entries[n].op = (op[0] == 'a') ? RECORD_MALLOC : RECORD_REALLOC;
+            entries[n].size = size;
+        }
+        else if(op[0] == 'f') {
+            entries[n].op = RECORD_FREE;
+        }
+        else {
+            break;
+        }
+        n++;
+    }
+    if(n != ops) {
+        free(entries);
+        return NULL;
+    }
+
+    *count = n;
+    return entries;
+}
+
+// Prints one point of the fragmentation curve.
+static void sample(size_t op) {
+    struct sf_stats stats;
+    sf_get_stats(&stats);
+    printf("%12zu %12zu %12.4f %12.4f\n", op, stats.heap_bytes, sf_internal_fragmentation(),
+           stats.heap_bytes ? (double) stats.requested_bytes / stats.heap_bytes : 0.0);
+}
+
+int main(int argc, char *argv[]) {
+    size_t samples = 20;
+    int opt;
+    while((opt = getopt(argc, argv, "n:")) != -1) {
+        if(opt == 'n') {samples = strtoul(optarg, NULL, 10);}
+        else {
+            fprintf(stderr, "usage: %s [-n samples] trace\n", argv[0]);
+            return EXIT_FAILURE;
+        }
+    }
+    if(optind != argc - 1) {
+        fprintf(stderr, "usage: %s [-n samples] trace\n", argv[0]);
+        return EXIT_FAILURE;
+    }
+
+    const char* path = argv[optind];
+    int fd = open(path, O_RDONLY);
+    struct stat st;
+    if(fd == -1 || fstat(fd, &st) == -1) {
+        perror(path);
+        return EXIT_FAILURE;
+    }
+
+    size_t count = 0;
+    const struct record_entry* entries = map_trace(fd, st.st_size, &count);
+    if(!entries) {
+        FILE* in = fdopen(fd, "r");
+        entries = in ? parse_rep(in, &count) : NULL;
+    }
+    if(!entries) {
+        fprintf(stderr, "%s: not a binary or .rep trace\n", path);
+        return EXIT_FAILURE;
+    }
+
+    // Objects are numbered densely, so a table indexed by id holds their current addresses.
+    uint32_t max_id = 0;
+    for(size_t i = 0; i < count; i++) {
+        if(entries[i].id > max_id) {max_id = entries[i].id;}
+    }
+    void** ptrs = calloc((size_t) max_id + 1, sizeof(*ptrs));
+    if(!ptrs) {
+        fprintf(stderr, "out of memory for %lu objects\n", (unsigned long) max_id + 1);
+        return EXIT_FAILURE;
+    }
+
+    size_t sample_every = (samples && count) ? (count + samples - 1) / samples : 0;
+    size_t failed = 0;
+    double sampling = 0.0;
+
+    printf("%12s %12s %12s %12s\n", "op", "heap bytes", "frag", "util");
+    double start = now_sec();
+    for(size_t i = 0; i < count; i++) {
+        const struct record_entry* entry = &entries[i];
+        void** ptr = &ptrs[entry->id];
+
+        if(entry->op == RECORD_MALLOC) {
+            *ptr = sf_malloc(entry->size);
+            if(!*ptr) {failed++;}
+        }
+        else if(entry->op == RECORD_REALLOC) {
+            // A realloc of an object the replay has no block for, because its allocation failed, starts a new one.
+            void* new_ptr = *ptr ? sf_realloc(*ptr, entry->size) : (entry->size ? sf_malloc(entry->size) : NULL);
+            if(new_ptr || !entry->size) {*ptr = new_ptr;}
+            else {failed++;}
+        }
+        else if(*ptr) {
+            sf_free(*ptr);
+            *ptr = NULL;
+        }
+
+        if(sample_every && (i + 1) % sample_every == 0) {
+            double sample_start = now_sec();
+            sample(i + 1);
+            sampling += now_sec() - sample_start;
+        }
+    }
+    double elapsed = now_sec() - start - sampling;
+
+    struct sf_stats stats;
+    sf_get_stats(&stats);
+    printf("\n%zu ops in %.3f s: %.2f Mops/s, %zu failed\n", count, elapsed, count / elapsed / 1e6, failed);
+    printf("final heap size: %zu bytes, fragmentation %.4f, peak utilization %.4f\n", stats.heap_bytes,
+           sf_internal_fragmentation(), sf_peak_utilization());
+
+    return EXIT_SUCCESS;
+}